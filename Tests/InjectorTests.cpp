@@ -7,6 +7,20 @@
 #define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
 #include <doctest.h>
 #include "Injector.hpp"
+#include "AsyncSingleton.h"
+#include "FactoryRegistry.h"
+#include "ManifestFile.h"
+#include "Recycled.h"
+#include "Sharded.h"
+#include "Shutdown.h"
+#include "ThreadLocal.h"
+#include "Tracer.h"
+#include <thread>
+#include <future>
+#include <fstream>
+#include <filesystem>
+#include <sstream>
+#include <mutex>
 using namespace LiiInjector;
 
 class TestInjectable : public Injectable
@@ -67,6 +81,31 @@ public:
     }
 
 };
+struct PlainConfig final
+{
+    int width = 640;
+    int height = 480;
+};
+
+class PlainInterface
+{
+public:
+    virtual ~PlainInterface() = default;
+    virtual int GetValue() = 0;
+};
+
+class PlainImplementation final : public PlainInterface
+{
+public:
+    int value;
+    explicit PlainImplementation(int value) : value(value)
+    {
+    }
+    int GetValue() override
+    {
+        return value;
+    }
+};
 
 
 TEST_CASE("Multiparam Test with strings and pointers")
@@ -305,6 +344,14 @@ TEST_CASE("Singleton registration and fail with polymorphism")
         CHECK_THROWS_WITH_AS(injector.ResolveSingletonTag<TestInjectableInterface>("test1"), "Singleton type mismatch!", std::runtime_error);
         CHECK_THROWS_WITH_AS(injector.ResolveSingletonTag<TestInjectableInterface>("test2"), "Singleton type mismatch!", std::runtime_error);
     }
+
+    SUBCASE("Factory with a tag key ")
+    {
+        injector.RegisterSingletonTag<TestInjectableInterface>([]() -> std::unique_ptr<Injectable>
+        { return std::make_unique<TestInjectable>(); }, 3);
+
+        CHECK_THROWS_WITH_AS(injector.ResolveSingletonTag<TestInjectableInterface>(3), "Singleton type mismatch!", std::runtime_error);
+    }
 }
 
 TEST_CASE("Singleton Registration exception")
@@ -880,5 +927,1734 @@ TEST_CASE("Transient registration and fail with polymorphism")
     }
 }
 
+TEST_CASE("Tag interning")
+{
+    auto injector = Injector{};
+    SUBCASE("Singleton and transient share tag ids")
+    {
+        auto id = injector.GetTagId("test");
+        CHECK(injector.GetTagId("test").value == id.value);
+        CHECK(injector.GetTagId("test2").value != id.value);
+
+        injector.RegisterSingletonTag<TestInjectable>("test");
+        injector.RegisterTransientTag<TestInjectable2>("test");
+        injector.ResolveSingletonTag<TestInjectable>(id)->a = 5;
+
+        CHECK(injector.ResolveSingletonTag<TestInjectable>("test")->a == 5);
+        CHECK(injector.ResolveTransientTag<TestInjectable2>(id)->a == 0);
+    }
+
+    SUBCASE("Resolve with an id")
+    {
+        auto id = injector.GetTagId("test");
+        injector.RegisterTransientTag<TestInjectable3>(
+                [](int a, float b, std::unique_ptr<TestInjectable2> c) -> Injectable *
+                {
+                    return new TestInjectable3(a, b, std::move(c));
+                }, id);
+
+        auto instance = injector.ResolveTransientTag<TestInjectable3>(id, 1, 2.0f, std::make_unique<TestInjectable2>());
+        CHECK(instance->a == 1);
+        CHECK(instance->b == 2.0f);
+    }
+
+    SUBCASE("Unknown or empty tags")
+    {
+        injector.RegisterSingletonTag<TestInjectable>("test");
+        auto unused = injector.GetTagId("unused");
+        CHECK_THROWS_WITH_AS(injector.ResolveSingletonTag<TestInjectable>(unused), "Singleton not registered!", std::runtime_error);
+        CHECK_THROWS_WITH_AS(injector.ResolveSingletonTag<TestInjectable>("missing"), "Singleton not registered!", std::runtime_error);
+        CHECK_THROWS_WITH_AS(injector.ResolveTransientTag<TestInjectable>("test"), "Type not registered!", std::runtime_error);
+        CHECK_THROWS_AS(injector.RegisterSingletonTag<TestInjectable>(injector.GetTagId("test")), std::runtime_error);
+    }
+
+    SUBCASE("Interning while other threads resolve")
+    {
+        injector.EnableReplace();
+        injector.RegisterSingletonTag<TestInjectable>("shared");
+        auto fork = injector.Fork();
+        auto child = injector.CreateChild();
+        bool resolved = true;
+        std::thread resolver([&]()
+        {
+            for (int i = 0; i < 1000; i++)
+            {
+                resolved = resolved && child.ResolveSingletonTag<TestInjectable>("shared") != nullptr &&
+                           injector.ResolveSingletonTag<TestInjectable>("shared") != nullptr;
+            }
+        });
+        for (int i = 0; i < 1000; i++)
+        {
+            fork.GetTagId("fork" + std::to_string(i));
+            injector.GetTagId("original" + std::to_string(i));
+        }
+        resolver.join();
+        CHECK(resolved);
+
+        // Ids interned before the fork stay valid in both, later ones belong to the Injector that interned them.
+        CHECK(fork.GetTagId("shared").value == injector.GetTagId("shared").value);
+        fork.RegisterSingletonTag<TestInjectable>("fork0");
+        CHECK(fork.ResolveSingletonTag<TestInjectable>("fork0") != nullptr);
+        CHECK_THROWS_WITH_AS(injector.ResolveSingletonTag<TestInjectable>("fork0"), "Singleton not registered!", std::runtime_error);
+    }
+}
+
+TEST_CASE("Registration of types that are not Injectable")
+{
+    auto injector = Injector{};
+    SUBCASE("Singletons")
+    {
+        injector.RegisterSingleton<PlainConfig>();
+        injector.RegisterSingleton<PlainInterface>([]()
+        {
+            return std::make_unique<PlainImplementation>(3);
+        });
+        injector.RegisterSingletonTag<PlainConfig>([]()
+        {
+            auto config = new PlainConfig();
+            config->width = 1920;
+            return config;
+        }, "hd");
+
+        CHECK(injector.ResolveSingleton<PlainConfig>()->width == 640);
+        CHECK(injector.ResolveSingleton<PlainInterface>()->GetValue() == 3);
+        CHECK(injector.ResolveSingletonTag<PlainConfig>("hd")->width == 1920);
+        CHECK_THROWS_WITH_AS(injector.ResolveSingletonTag<PlainImplementation>("hd"), "Singleton not registered!", std::runtime_error);
+    }
+
+    SUBCASE("Transients")
+    {
+        injector.RegisterTransient<PlainConfig>();
+        injector.RegisterTransient<PlainInterface>([](int value) -> PlainInterface*
+        {
+            return new PlainImplementation(value);
+        });
+        injector.RegisterTransientTag<PlainConfig>([](int width) -> PlainConfig*
+        {
+            auto config = new PlainConfig();
+            config->width = width;
+            return config;
+        }, "test");
+
+        CHECK(injector.ResolveTransient<PlainConfig>()->height == 480);
+        CHECK(injector.ResolveTransient<PlainInterface>(7)->GetValue() == 7);
+        CHECK(injector.ResolveTransientTag<PlainConfig>("test", 800)->width == 800);
+        CHECK_THROWS_WITH_AS(injector.ResolveTransientTag<PlainConfig>("test"), "Type not registered!", std::runtime_error);
+        CHECK_THROWS_WITH_AS(injector.ResolveTransientTag<TestInjectable>("test", 800), "Type not registered!", std::runtime_error);
+    }
+}
+
+namespace
+{
+    struct AnonymousConfig
+    {
+        int value = 5;
+    };
+}
+
+TEST_CASE("Type ids")
+{
+    SUBCASE("Ids and names")
+    {
+        CHECK(TypeId::Of<PlainConfig>() == TypeId::Of<PlainConfig>());
+        CHECK(TypeId::Of<PlainConfig>() != TypeId::Of<PlainInterface>());
+        CHECK(std::string(TypeId::Name<PlainConfig>()).find("PlainConfig") != std::string::npos);
+    }
+
+    SUBCASE("Names from another module")
+    {
+        // Every module keeps its own copy of a name, only the text matches.
+        std::string name = TypeId::Name<PlainConfig>();
+        CHECK(TypeId::Is<PlainConfig>(name.c_str()));
+        CHECK_FALSE(TypeId::Is<PlainInterface>(name.c_str()));
+    }
+
+    SUBCASE("Types without linkage")
+    {
+        auto injector = Injector{};
+        injector.RegisterSingleton<AnonymousConfig>();
+        CHECK(injector.ResolveSingleton<AnonymousConfig>()->value == 5);
+        CHECK(TypeId::Of<AnonymousConfig>() == TypeId::Of<AnonymousConfig>());
+    }
+}
+
+TEST_CASE("Value registration and resolve")
+{
+    auto injector = Injector{};
+    SUBCASE("Default and factory")
+    {
+        injector.RegisterValue<PlainConfig>();
+        injector.RegisterValue<PlainConfig>([](int width, int height)
+        {
+            return PlainConfig{width, height};
+        });
+
+        PlainConfig config = injector.ResolveValue<PlainConfig>();
+        PlainConfig custom = injector.ResolveValue<PlainConfig>(1920, 1080);
+        CHECK(config.width == 640);
+        CHECK(custom.width == 1920);
+        CHECK(custom.height == 1080);
+    }
+
+    SUBCASE("Non movable values are built in place")
+    {
+        struct Pinned
+        {
+            int value;
+            explicit Pinned(int value) : value(value)
+            {
+            }
+            Pinned(const Pinned&) = delete;
+            Pinned(Pinned&&) = delete;
+        };
+
+        injector.RegisterValue<Pinned>([](int value)
+        {
+            return Pinned(value);
+        });
+        Pinned pinned = injector.ResolveValue<Pinned>(4);
+        CHECK(pinned.value == 4);
+    }
+
+    SUBCASE("Failures")
+    {
+        injector.RegisterValue<PlainConfig>();
+        CHECK_THROWS_AS(injector.RegisterValue<PlainConfig>(), std::runtime_error);
+        CHECK_THROWS_WITH_AS(injector.ResolveValue<PlainConfig>(1), "Type not registered!", std::runtime_error);
+    }
+}
+
+TEST_CASE("Placement transient registration and resolve")
+{
+    auto injector = Injector{};
+    SUBCASE("Without a tag")
+    {
+        injector.RegisterTransientInto<PlainConfig>();
+        injector.RegisterTransientInto<PlainInterface>([](void* storage, int value)
+        {
+            return new (storage) PlainImplementation(value);
+        });
+
+        auto layout = injector.GetTransientLayout<PlainInterface, int>();
+        CHECK(layout.size == sizeof(PlainImplementation));
+        CHECK(layout.alignment == alignof(PlainImplementation));
+        CHECK(injector.GetTransientLayout<PlainConfig>().size == sizeof(PlainConfig));
+
+        alignas(PlainImplementation) unsigned char storage[sizeof(PlainImplementation)];
+        auto* instance = injector.ResolveTransientInto<PlainInterface>(storage, sizeof(storage), 9);
+        CHECK(static_cast<void*>(instance) == static_cast<void*>(storage));
+        CHECK(instance->GetValue() == 9);
+        instance->~PlainInterface();
+
+        alignas(PlainConfig) unsigned char configStorage[sizeof(PlainConfig)];
+        auto* config = injector.ResolveTransientInto<PlainConfig>(configStorage, sizeof(configStorage));
+        CHECK(config->width == 640);
+        config->~PlainConfig();
+    }
+
+    SUBCASE("With a tag")
+    {
+        injector.RegisterTransientIntoTag<PlainConfig>("default");
+        injector.RegisterTransientIntoTag<PlainConfig>([](void* storage, int width)
+        {
+            auto* config = new (storage) PlainConfig();
+            config->width = width;
+            return config;
+        }, "custom");
+
+        CHECK(injector.GetTransientLayoutTag<int>("custom").size == sizeof(PlainConfig));
+        PlainConfig storage[2];
+        auto* config = injector.ResolveTransientIntoTag<PlainConfig>("custom", &storage[0], sizeof(PlainConfig), 1024);
+        auto* defaultConfig = injector.ResolveTransientIntoTag<PlainConfig>(injector.GetTagId("default"), &storage[1], sizeof(PlainConfig));
+        CHECK(config->width == 1024);
+        CHECK(defaultConfig->width == 640);
+    }
+
+    SUBCASE("Failures")
+    {
+        injector.RegisterTransientInto<PlainConfig>();
+        injector.RegisterTransientIntoTag<PlainConfig>("test");
+        PlainConfig storage[2];
+        CHECK_THROWS_AS(injector.RegisterTransientInto<PlainConfig>(), std::runtime_error);
+        CHECK_THROWS_WITH_AS(injector.ResolveTransientInto<PlainConfig>(storage, sizeof(PlainConfig) - 1), "Storage does not fit the type!", std::runtime_error);
+        CHECK_THROWS_WITH_AS(injector.ResolveTransientInto<PlainConfig>(reinterpret_cast<unsigned char*>(storage) + 1, sizeof(PlainConfig)), "Storage does not fit the type!", std::runtime_error);
+        CHECK_THROWS_WITH_AS(injector.ResolveTransientInto<PlainConfig>(storage, sizeof(PlainConfig), 1), "Type not registered!", std::runtime_error);
+        CHECK_THROWS_WITH_AS(injector.ResolveTransientIntoTag<PlainConfig>("test", storage, sizeof(PlainConfig), 1), "Factory function mismatch!", std::runtime_error);
+        CHECK_THROWS_WITH_AS(injector.ResolveTransientIntoTag<TestInjectable>("test", storage, sizeof(storage)), "Type mismatch!", std::runtime_error);
+    }
+}
+
+TEST_CASE("Shared singleton registration and resolve")
+{
+    SUBCASE("Handles outlive the injector")
+    {
+        SharedHandle<PlainInterface> handle;
+        WeakHandle<PlainInterface> weak;
+        {
+            auto injector = Injector{};
+            injector.RegisterSharedSingleton<PlainInterface>([]()
+            {
+                return PlainImplementation(3);
+            });
+            handle = injector.ResolveShared<PlainInterface>();
+            weak = handle;
+            CHECK(handle.UseCount() == 2);
+            CHECK(injector.ResolveSingleton<PlainInterface>() == handle.Get());
+        }
+        CHECK(handle.UseCount() == 1);
+        CHECK(handle->GetValue() == 3);
+        CHECK(weak.Lock()->GetValue() == 3);
+
+        handle.Reset();
+        CHECK(weak.Expired());
+        CHECK_FALSE(weak.Lock());
+    }
+
+    SUBCASE("With a tag")
+    {
+        auto injector = Injector{};
+        injector.RegisterSharedSingletonTag<PlainConfig>("default");
+        injector.RegisterSharedSingletonTag<TestInjectableInterface, TestInjectable2>("test");
+
+        auto config = injector.ResolveSharedTag<PlainConfig>("default");
+        auto instance = injector.ResolveSharedTag<TestInjectableInterface>(injector.GetTagId("test"));
+        CHECK(config->width == 640);
+        CHECK(instance->GetA() == 0);
+    }
+
+    SUBCASE("Failures")
+    {
+        auto injector = Injector{};
+        injector.RegisterSharedSingleton<PlainConfig>();
+        injector.RegisterSingleton<TestInjectable>();
+        CHECK_THROWS_WITH_AS(injector.RegisterSharedSingleton<PlainConfig>(), "Singleton already registered!", std::runtime_error);
+        injector.RegisterSharedSingletonTag<PlainConfig>("config", Teardown::LeakOnFastShutdown);
+        CHECK_THROWS_WITH_AS(injector.RegisterSharedSingletonTag<PlainConfig>("config", Teardown::Destroy),
+                             "Singleton already registered!", std::runtime_error);
+        CHECK_THROWS_WITH_AS(injector.ResolveShared<TestInjectable>(), "Singleton is not shared!", std::runtime_error);
+        CHECK_THROWS_WITH_AS(injector.ResolveShared<TestInjectable2>(), "Singleton not registered!", std::runtime_error);
+    }
+}
+
+TEST_CASE("Child injectors")
+{
+    auto injector = Injector{};
+    injector.RegisterSingleton<TestInjectable>();
+    injector.RegisterSingletonTag<PlainConfig>("config");
+    injector.RegisterTransient<TestInjectableInterface>([]() -> TestInjectableInterface*
+    {
+        return new TestInjectable2();
+    });
+
+    SUBCASE("Child sees the parent registrations")
+    {
+        auto child = injector.CreateChild();
+        CHECK(child.ResolveSingleton<TestInjectable>() == injector.ResolveSingleton<TestInjectable>());
+        CHECK(child.ResolveSingletonTag<PlainConfig>("config") == injector.ResolveSingletonTag<PlainConfig>("config"));
+        CHECK(child.ResolveTransient<TestInjectableInterface>()->GetA() == 0);
+    }
+
+    SUBCASE("Child overrides do not leak into the parent")
+    {
+        auto child = injector.CreateChild();
+        child.RegisterSingleton<TestInjectable>([]()
+        {
+            auto instance = std::make_unique<TestInjectable>();
+            instance->a = 5;
+            return instance;
+        });
+        child.RegisterSingletonTag<PlainConfig>([]()
+        {
+            return new PlainConfig{1920, 1080};
+        }, "config");
+        child.RegisterSingleton<TestInjectable2>();
+
+        CHECK(child.ResolveSingleton<TestInjectable>()->a == 5);
+        CHECK(child.ResolveSingletonTag<PlainConfig>("config")->width == 1920);
+        CHECK(injector.ResolveSingleton<TestInjectable>()->a == 0);
+        CHECK(injector.ResolveSingletonTag<PlainConfig>("config")->width == 640);
+        CHECK_THROWS_AS(injector.ResolveSingleton<TestInjectable2>(), std::runtime_error);
+        CHECK_THROWS_AS(child.RegisterSingleton<TestInjectable2>(), std::runtime_error);
+    }
+
+    SUBCASE("Grandchildren see every ancestor")
+    {
+        auto child = injector.CreateChild();
+        child.RegisterSingleton<TestInjectable2>();
+        auto grandchild = child.CreateChild();
+        grandchild.RegisterValue<PlainConfig>();
+
+        CHECK(grandchild.ResolveSingleton<TestInjectable>() == injector.ResolveSingleton<TestInjectable>());
+        CHECK(grandchild.ResolveSingleton<TestInjectable2>() == child.ResolveSingleton<TestInjectable2>());
+        CHECK(grandchild.ResolveValue<PlainConfig>().width == 640);
+        CHECK_THROWS_AS(child.ResolveValue<PlainConfig>(), std::runtime_error);
+    }
+
+    SUBCASE("Parent registrations after the child was created stay in the parent")
+    {
+        auto child = injector.CreateChild();
+        injector.RegisterSingleton<TestInjectable2>();
+        CHECK(injector.ResolveSingleton<TestInjectable2>()->a == 0);
+        CHECK_THROWS_AS(child.ResolveSingleton<TestInjectable2>(), std::runtime_error);
+    }
+
+    SUBCASE("Inherited singletons outlive the parent")
+    {
+        auto parent = Injector{};
+        parent.RegisterSingleton<TestInjectable>();
+        auto child = parent.CreateChild();
+        parent.ResolveSingleton<TestInjectable>()->a = 3;
+        parent = Injector{};
+        CHECK(child.ResolveSingleton<TestInjectable>()->a == 3);
+    }
+}
+
+struct ConstantHash
+{
+    std::size_t operator()(int) const
+    {
+        return 42;
+    }
+};
+
+TEST_CASE("Persistent map")
+{
+    SUBCASE("Copies are not affected by writes")
+    {
+        PersistentMap<std::uint32_t, int> map;
+        for (std::uint32_t i = 0; i < 1000; i++)
+            map.Set(i, static_cast<int>(i));
+        auto copy = map;
+        for (std::uint32_t i = 0; i < 1000; i += 2)
+            copy.Set(i, -1);
+        CHECK(copy.Insert(5000, 1));
+        CHECK_FALSE(copy.Insert(1, 1));
+
+        CHECK(map.Size() == 1000);
+        CHECK(copy.Size() == 1001);
+        for (std::uint32_t i = 0; i < 1000; i++)
+        {
+            CHECK(*map.Find(i) == static_cast<int>(i));
+            CHECK(*copy.Find(i) == (i % 2 == 0 ? -1 : static_cast<int>(i)));
+        }
+        CHECK(map.Find(5000) == nullptr);
+    }
+
+    SUBCASE("Colliding hashes")
+    {
+        PersistentMap<int, int, ConstantHash> map;
+        for (int i = 0; i < 10; i++)
+            map.Set(i, i * 2);
+        map.Set(3, 7);
+        CHECK(map.Size() == 10);
+        CHECK(*map.Find(3) == 7);
+        CHECK(*map.Find(9) == 18);
+        CHECK(map.Find(10) == nullptr);
+        CHECK(map.Erase(3));
+        CHECK_FALSE(map.Erase(3));
+        CHECK(map.Size() == 9);
+        CHECK(map.Find(3) == nullptr);
+        CHECK(*map.Find(4) == 8);
+    }
+
+    SUBCASE("Erasing and compacting")
+    {
+        PersistentMap<std::uint32_t, int> map;
+        for (std::uint32_t i = 0; i < 1000; i++)
+            map.Set(i, static_cast<int>(i));
+        auto copy = map;
+        for (std::uint32_t i = 0; i < 1000; i += 3)
+            CHECK(map.Erase(i));
+        CHECK_FALSE(map.Erase(3000));
+        CHECK(map.Size() == 666);
+        CHECK(copy.Size() == 1000);
+
+        auto compacted = map.Compacted();
+        CHECK(compacted.Size() == 666);
+        std::size_t visited = 0;
+        compacted.ForEach([&](std::uint32_t key, int value)
+        {
+            CHECK(key % 3 != 0);
+            CHECK(value == static_cast<int>(key));
+            visited++;
+        });
+        CHECK(visited == 666);
+        for (std::uint32_t i = 0; i < 1000; i++)
+        {
+            CHECK((map.Find(i) == nullptr) == (i % 3 == 0));
+            CHECK((compacted.Find(i) == nullptr) == (i % 3 == 0));
+            CHECK(*copy.Find(i) == static_cast<int>(i));
+        }
+
+        for (std::uint32_t i = 0; i < 1000; i++)
+            compacted.Erase(i);
+        CHECK(compacted.Size() == 0);
+        CHECK(compacted.Find(1) == nullptr);
+        compacted.Set(1, 1);
+        CHECK(*compacted.Find(1) == 1);
+    }
+}
+
+TEST_CASE("Forking an injector")
+{
+    auto injector = Injector{};
+    injector.RegisterSingleton<TestInjectable>();
+    injector.RegisterTransientTag<PlainConfig>("config");
+
+    auto fork = injector.Fork();
+    fork.RegisterSingleton<TestInjectable2>();
+    injector.RegisterValue<PlainConfig>();
+
+    CHECK(fork.ResolveSingleton<TestInjectable>() == injector.ResolveSingleton<TestInjectable>());
+    CHECK(fork.ResolveTransientTag<PlainConfig>("config")->width == 640);
+    CHECK(fork.ResolveSingleton<TestInjectable2>()->a == 0);
+    CHECK_THROWS_AS(injector.ResolveSingleton<TestInjectable2>(), std::runtime_error);
+    CHECK_THROWS_AS(fork.ResolveValue<PlainConfig>(), std::runtime_error);
+    CHECK_THROWS_AS(fork.RegisterSingleton<TestInjectable>(), std::runtime_error);
+
+    auto childFork = injector.CreateChild().Fork();
+    childFork.RegisterSingleton<TestInjectable>();
+    CHECK(childFork.ResolveSingleton<TestInjectable>() != injector.ResolveSingleton<TestInjectable>());
+}
+
+TEST_CASE("Thread local registration and resolve")
+{
+    static std::atomic<int> destroyed{0};
+    struct Scratch
+    {
+        int value = 0;
+        ~Scratch()
+        {
+            destroyed++;
+        }
+    };
+
+    auto injector = Injector{};
+    injector.RegisterThreadLocal<Scratch>();
+    injector.RegisterThreadLocal<TestInjectableInterface>([]()
+    {
+        return std::make_unique<TestInjectable2>();
+    });
+
+    auto* mainScratch = injector.ResolveThreadLocal<Scratch>();
+    CHECK(injector.ResolveThreadLocal<Scratch>() == mainScratch);
+    CHECK(injector.ResolveThreadLocal<TestInjectableInterface>()->GetA() == 0);
+
+    Scratch* otherScratch = nullptr;
+    std::thread thread([&]()
+    {
+        otherScratch = injector.ResolveThreadLocal<Scratch>();
+        otherScratch->value = 5;
+    });
+    thread.join();
+
+    CHECK(otherScratch != mainScratch);
+    CHECK(destroyed == 1);
+    CHECK(mainScratch->value == 0);
+    CHECK_THROWS_AS(injector.RegisterThreadLocal<Scratch>(), std::runtime_error);
+    CHECK_THROWS_WITH_AS(injector.ResolveThreadLocal<TestInjectable>(), "Type not registered!", std::runtime_error);
+
+    // Removing the registration destroys the instances of threads that are still running.
+    std::atomic<bool> resolved{false};
+    std::atomic<bool> removed{false};
+    std::thread running([&]()
+    {
+        injector.ResolveThreadLocal<Scratch>()->value = 3;
+        resolved = true;
+        while (!removed)
+            std::this_thread::yield();
+    });
+    while (!resolved)
+        std::this_thread::yield();
+    injector.Unregister<Scratch>();
+    CHECK(destroyed == 3);
+    removed = true;
+    running.join();
+    CHECK(destroyed == 3);
+
+    // A later registration may reuse the slot of the removed one, it still builds its own instances.
+    injector.RegisterThreadLocal<Scratch>();
+    CHECK(injector.ResolveThreadLocal<Scratch>()->value == 0);
+    CHECK(destroyed == 3);
+}
+
+#ifdef LII_INJECTOR_COROUTINES
+struct DetachedTask
+{
+    struct promise_type
+    {
+        DetachedTask get_return_object()
+        {
+            return {};
+        }
+
+        std::suspend_never initial_suspend()
+        {
+            return {};
+        }
+
+        std::suspend_never final_suspend() noexcept
+        {
+            return {};
+        }
+
+        void return_void()
+        {
+        }
+
+        void unhandled_exception()
+        {
+            std::terminate();
+        }
+    };
+};
+
+DetachedTask AwaitSingleton(Injector& injector, std::promise<TestInjectable*>& result)
+{
+    result.set_value(co_await injector.ResolveAsync<TestInjectable>());
+}
+#endif
+
+TEST_CASE("Async singleton registration and resolve")
+{
+    static std::atomic<int> constructions{0};
+    auto injector = Injector{};
+    std::promise<void> release;
+    auto released = release.get_future().share();
+    injector.RegisterAsyncSingleton<TestInjectable>([released]()
+    {
+        released.wait();
+        constructions++;
+        return new TestInjectable();
+    });
+    injector.RegisterAsyncSingleton<TestInjectableInterface>([]()
+    {
+        return std::async(std::launch::async, []()
+        { return std::make_unique<TestInjectable2>(); });
+    });
+    injector.RegisterAsyncSingleton<int>([]() -> int*
+    {
+        throw std::runtime_error("Factory failed!");
+    });
+
+    SUBCASE("Concurrent resolves share one construction")
+    {
+        auto first = injector.ResolveAsync<TestInjectable>();
+        auto second = injector.ResolveAsync<TestInjectable>();
+        CHECK_FALSE(first.Ready());
+        release.set_value();
+        CHECK(first.Get() == second.Get());
+        CHECK(first.Ready());
+        CHECK(constructions == 1);
+        CHECK(injector.ResolveAsync<TestInjectableInterface>().Get()->GetA() == 0);
+    }
+
+    SUBCASE("Factory exceptions are rethrown")
+    {
+        release.set_value();
+        CHECK_THROWS_WITH_AS(injector.ResolveAsync<int>().Get(), "Factory failed!", std::runtime_error);
+        CHECK_THROWS_WITH_AS(injector.ResolveAsync<double>(), "Type not registered!", std::runtime_error);
+        CHECK_THROWS_AS(injector.RegisterAsyncSingleton<int>(), std::runtime_error);
+    }
+
+#ifdef LII_INJECTOR_COROUTINES
+    SUBCASE("Awaiters resume once the construction finished")
+    {
+        std::promise<TestInjectable*> awaited;
+        auto result = awaited.get_future();
+        AwaitSingleton(injector, awaited);
+        CHECK(result.wait_for(std::chrono::milliseconds(10)) == std::future_status::timeout);
+        release.set_value();
+        CHECK(result.get() == injector.ResolveAsync<TestInjectable>().Get());
+    }
+#endif
+}
+
+TEST_CASE("Multi bindings")
+{
+    auto injector = Injector{};
+    CHECK(injector.ResolveAll<TestInjectableInterface>().empty());
+    CHECK(injector.ResolveAllTransient<TestInjectableInterface>().empty());
+
+    injector.RegisterMulti<TestInjectableInterface, TestInjectable2>();
+    injector.RegisterMulti<TestInjectableInterface>([]()
+    {
+        auto handler = std::make_unique<TestInjectable2>();
+        handler->a = 7;
+        return handler;
+    });
+    injector.RegisterMultiTransient<PlainInterface>([]()
+    { return new PlainImplementation(1); });
+    injector.RegisterMultiTransient<PlainInterface>([]()
+    { return std::make_unique<PlainImplementation>(2); });
+
+    SUBCASE("Singletons are kept contiguous in registration order")
+    {
+        auto handlers = injector.ResolveAll<TestInjectableInterface>();
+        REQUIRE(handlers.size() == 2);
+        CHECK(handlers[0]->GetA() == 0);
+        CHECK(handlers[1]->GetA() == 7);
+        CHECK(handlers.data() + 1 == &handlers[1]);
+        CHECK(injector.ResolveAll<TestInjectableInterface>()[0] == handlers[0]);
+    }
+
+    SUBCASE("Transients are created on every resolve")
+    {
+        auto first = injector.ResolveAllTransient<PlainInterface>();
+        auto second = injector.ResolveAllTransient<PlainInterface>();
+        REQUIRE(first.size() == 2);
+        CHECK(first[0]->GetValue() == 1);
+        CHECK(first[1]->GetValue() == 2);
+        CHECK(first[0] != second[0]);
+    }
+
+    SUBCASE("Children append without changing the parent")
+    {
+        auto child = injector.CreateChild();
+        child.RegisterMulti<TestInjectableInterface, TestInjectable2>();
+        CHECK(child.ResolveAll<TestInjectableInterface>().size() == 3);
+        CHECK(child.ResolveAll<TestInjectableInterface>()[0] == injector.ResolveAll<TestInjectableInterface>()[0]);
+        CHECK(injector.ResolveAll<TestInjectableInterface>().size() == 2);
+    }
+}
+
+class CountingProxy final : public TestInjectableInterface
+{
+public:
+    static inline int calls = 0;
+    std::unique_ptr<TestInjectableInterface> inner;
+    explicit CountingProxy(TestInjectableInterface* inner) : inner(inner)
+    {
+    }
+
+    int GetA() override
+    {
+        calls++;
+        return inner->GetA();
+    }
+};
+
+TEST_CASE("Decorated factories")
+{
+    auto injector = Injector{};
+    CountingProxy::calls = 0;
+    auto addOne = [](TestInjectable3* product)
+    {
+        product->a++;
+        return product;
+    };
+    auto proxy = [](TestInjectableInterface* product)
+    {
+        return new CountingProxy(product);
+    };
+
+    SUBCASE("Transient decorators run in order on every resolve")
+    {
+        injector.RegisterTransient<TestInjectableInterface>(Decorate([](int a, float b)
+        {
+            return new TestInjectable3(a, b, nullptr);
+        }, addOne, addOne, proxy));
+
+        auto first = injector.ResolveTransient<TestInjectableInterface>(5, 1.0f);
+        auto second = injector.ResolveTransient<TestInjectableInterface>(1, 1.0f);
+        CHECK(first->GetA() == 7);
+        CHECK(second->GetA() == 3);
+        CHECK(CountingProxy::calls == 2);
+    }
+
+    SUBCASE("Singleton decorators run once")
+    {
+        std::function<TestInjectableInterface*(TestInjectableInterface*)> runtimeProxy = proxy;
+        injector.RegisterSingleton<TestInjectableInterface>(Decorate([]()
+        {
+            return new TestInjectable3(1, 0, nullptr);
+        }, addOne, runtimeProxy));
+
+        auto* singleton = injector.ResolveSingleton<TestInjectableInterface>();
+        CHECK(dynamic_cast<CountingProxy*>(singleton) != nullptr);
+        CHECK(singleton->GetA() == 2);
+        CHECK(CountingProxy::calls == 1);
+    }
+
+    SUBCASE("Without decorators the factory is unchanged")
+    {
+        auto plain = Decorate([](int value)
+        {
+            return new PlainImplementation(value);
+        });
+        injector.RegisterTransient<PlainInterface>(std::move(plain));
+        CHECK(injector.ResolveTransient<PlainInterface>(3)->GetValue() == 3);
+    }
+}
+
+struct RecycledParser
+{
+    static inline int constructions = 0;
+    static inline int destructions = 0;
+    std::vector<int> table;
+    int resets = 0;
+    RecycledParser()
+    {
+        constructions++;
+        table.reserve(64);
+    }
+
+    ~RecycledParser()
+    {
+        destructions++;
+    }
+
+    void Reset()
+    {
+        table.clear();
+        resets++;
+    }
+};
+
+struct RecycledBuffer
+{
+    int value = 0;
+};
+
+TEST_CASE("Recycled registration and resolve")
+{
+    RecycledParser::constructions = 0;
+    auto injector = Injector{};
+    injector.RegisterRecycled<RecycledParser>();
+    injector.RegisterRecycled<RecycledBuffer>([]()
+    { return std::make_unique<RecycledBuffer>(); }, 1);
+
+    SUBCASE("Released instances are reset and reused")
+    {
+        auto first = injector.ResolveRecycled<RecycledParser>();
+        auto* address = first.get();
+        first->table.push_back(1);
+        first.reset();
+
+        auto second = injector.ResolveRecycled<RecycledParser>();
+        CHECK(second.get() == address);
+        CHECK(second->table.empty());
+        CHECK(second->table.capacity() >= 64);
+        CHECK(second->resets == 1);
+        CHECK(RecycledParser::constructions == 1);
+    }
+
+    SUBCASE("Types without Reset are reused as they are")
+    {
+        auto first = injector.ResolveRecycled<RecycledBuffer>();
+        first->value = 3;
+        first.reset();
+        CHECK(injector.ResolveRecycled<RecycledBuffer>()->value == 3);
+    }
+
+    SUBCASE("Free lists are per thread and bounded")
+    {
+        auto first = injector.ResolveRecycled<RecycledBuffer>();
+        auto second = injector.ResolveRecycled<RecycledBuffer>();
+        auto* kept = first.get();
+        first.reset();
+        second.reset();
+        CHECK(injector.ResolveRecycled<RecycledBuffer>().get() == kept);
+
+        std::thread([&]()
+        {
+            CHECK(injector.ResolveRecycled<RecycledBuffer>().get() != kept);
+        }).join();
+    }
+
+    SUBCASE("Free lists go with the registration")
+    {
+        RecycledParser::destructions = 0;
+        injector.ResolveRecycled<RecycledParser>().reset();
+        CHECK(RecycledParser::destructions == 0);
+        injector.Unregister<RecycledParser>();
+        CHECK(RecycledParser::destructions == 1);
+    }
+
+    SUBCASE("Handles outlive their Injector")
+    {
+        auto handle = injector.ResolveRecycled<RecycledParser>();
+        injector = Injector{};
+        handle.reset();
+        CHECK_THROWS_WITH_AS(injector.ResolveRecycled<RecycledParser>(), "Type not registered!", std::runtime_error);
+    }
+}
+
+enum class Quality
+{
+    Low,
+    Medium,
+    High
+};
+
+TEST_CASE("Integral and enum tag keys")
+{
+    auto injector = Injector{};
+    injector.RegisterSingletonTag<TestInjectableInterface>([]()
+    { return new TestInjectable3(1, 0, nullptr); }, Quality::Low);
+    injector.RegisterSingletonTag<TestInjectableInterface>([]()
+    { return new TestInjectable3(3, 0, nullptr); }, Quality::High);
+    injector.RegisterSingletonTag<PlainConfig>(0);
+    injector.RegisterTransientTag<TestInjectableInterface>([](int a)
+    { return new TestInjectable3(a, 0, nullptr); }, 2);
+    injector.RegisterTransientTag<TestInjectable2>(7u);
+
+    SUBCASE("Keys resolve their own registration")
+    {
+        CHECK(injector.ResolveSingletonTag<TestInjectableInterface>(Quality::Low)->GetA() == 1);
+        CHECK(injector.ResolveSingletonTag<TestInjectableInterface>(Quality::High)->GetA() == 3);
+        CHECK(injector.ResolveSingletonTag<PlainConfig>(0)->width == 640);
+        CHECK(injector.ResolveTransientTag<TestInjectableInterface, int>(2, 5)->GetA() == 5);
+        CHECK(injector.ResolveTransientTag<TestInjectable2>(7u)->GetA() == 0);
+    }
+
+    SUBCASE("Keys are separate per type and from string tags")
+    {
+        CHECK_THROWS_WITH_AS(injector.ResolveSingletonTag<TestInjectableInterface>(Quality::Medium), "Singleton not registered!", std::runtime_error);
+        CHECK_THROWS_WITH_AS(injector.ResolveSingletonTag<PlainConfig>(2), "Singleton not registered!", std::runtime_error);
+        CHECK_THROWS_WITH_AS(injector.ResolveSingletonTag<TestInjectableInterface>("2"), "Singleton not registered!", std::runtime_error);
+        CHECK_THROWS_WITH_AS(injector.ResolveTransientTag<TestInjectableInterface>(2), "Factory function mismatch!", std::runtime_error);
+    }
+
+    SUBCASE("Errors")
+    {
+        CHECK_THROWS_WITH_AS(injector.RegisterSingletonTag<PlainConfig>(0), "Singleton already registered!", std::runtime_error);
+        CHECK_THROWS_WITH_AS(injector.RegisterSingletonTag<PlainConfig>(-1), "Tag key out of range!", std::runtime_error);
+        CHECK_THROWS_WITH_AS(injector.ResolveSingletonTag<PlainConfig>(maxTagKey), "Tag key out of range!", std::runtime_error);
+    }
+
+    SUBCASE("Children merge their keys with the parent's")
+    {
+        auto child = injector.CreateChild();
+        child.RegisterSingletonTag<TestInjectableInterface>([]()
+        { return new TestInjectable3(2, 0, nullptr); }, Quality::Medium);
+        CHECK(child.ResolveSingletonTag<TestInjectableInterface>(Quality::Low)->GetA() == 1);
+        CHECK(child.ResolveSingletonTag<TestInjectableInterface>(Quality::Medium)->GetA() == 2);
+        CHECK_THROWS_AS(injector.ResolveSingletonTag<TestInjectableInterface>(Quality::Medium), std::runtime_error);
+    }
+}
+
+TEST_CASE("Registration manifest")
+{
+    ManifestWriter writer;
+    writer.Add("renderer.fast", ManifestKind::Singleton, 1);
+    writer.Add("renderer.exact", ManifestKind::Singleton, 2);
+    writer.Add("config", ManifestKind::Transient, 3);
+    auto bytes = writer.Build();
+
+    FactoryRegistry factories;
+    factories.AddSingleton<TestInjectableInterface>(1, []()
+    { return new TestInjectable3(1, 0, nullptr); });
+    factories.AddSingleton<TestInjectableInterface>(2, []()
+    { return new TestInjectable3(2, 0, nullptr); });
+    factories.AddTransient<TestInjectable3>(3, [](int a)
+    { return new TestInjectable3(a, 0, nullptr); });
+
+    SUBCASE("Lookups use the prebuilt table")
+    {
+        Manifest manifest(bytes.data(), bytes.size());
+        CHECK(manifest.Size() == 3);
+        REQUIRE(manifest.Find("config") != nullptr);
+        CHECK(manifest.Find("config")->factoryId == 3);
+        CHECK(manifest.Name(*manifest.Find("renderer.fast")) == "renderer.fast");
+        CHECK(manifest.Find("renderer") == nullptr);
+    }
+
+    SUBCASE("Adopting a memory mapped manifest")
+    {
+        auto path = (std::filesystem::temp_directory_path() / "LiiInjectorManifest.bin").string();
+        std::ofstream(path, std::ios::binary).write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+        {
+            MappedFile file(path);
+            auto injector = Injector{};
+            injector.AdoptManifest(Manifest(file.Data(), file.Size()), factories);
+            CHECK(injector.ResolveSingletonTag<TestInjectableInterface>("renderer.fast")->GetA() == 1);
+            CHECK(injector.ResolveSingletonTag<TestInjectableInterface>("renderer.exact")->GetA() == 2);
+            CHECK(injector.ResolveTransientTag<TestInjectable3, int>("config", 4)->GetA() == 4);
+        }
+        std::filesystem::remove(path);
+        CHECK_THROWS_WITH_AS(MappedFile{path}, "Cannot map file!", std::runtime_error);
+    }
+
+    SUBCASE("Errors")
+    {
+        CHECK_THROWS_WITH_AS(writer.Add("config", ManifestKind::Singleton, 1), "Tag already in manifest!", std::runtime_error);
+        CHECK_THROWS_WITH_AS(factories.AddTransient<TestInjectable2>(3, []()
+        { return new TestInjectable2(); }), "Factory id already registered!", std::runtime_error);
+
+        auto corrupt = bytes;
+        corrupt[0] = 'X';
+        CHECK_THROWS_WITH_AS(Manifest(corrupt.data(), corrupt.size()), "Invalid manifest!", std::runtime_error);
+        CHECK_THROWS_WITH_AS(Manifest(bytes.data(), bytes.size() - 1), "Invalid manifest!", std::runtime_error);
+
+        // Written on a machine of the other byte order.
+        auto swapped = bytes;
+        std::reverse(swapped.begin() + offsetof(ManifestHeader, version),
+                     swapped.begin() + offsetof(ManifestHeader, version) + sizeof(std::uint32_t));
+        CHECK_THROWS_WITH_AS(Manifest(swapped.data(), swapped.size()), "Manifest byte order mismatch!", std::runtime_error);
+
+        // Without an empty bucket Find would never stop probing for a missing tag.
+        auto full = bytes;
+        ManifestHeader header{};
+        std::memcpy(&header, full.data(), sizeof(header));
+        for (std::uint32_t bucket = 0; bucket < header.bucketCount; bucket++)
+        {
+            std::uint32_t entry = 1;
+            std::memcpy(full.data() + header.bucketsOffset + bucket * sizeof(entry), &entry, sizeof(entry));
+        }
+        CHECK_THROWS_WITH_AS(Manifest(full.data(), full.size()), "Invalid manifest!", std::runtime_error);
+
+        ManifestWriter mismatched;
+        mismatched.Add("config", ManifestKind::Singleton, 3);
+        mismatched.Add("unknown", ManifestKind::Singleton, 9);
+        auto mismatchedBytes = mismatched.Build();
+        auto injector = Injector{};
+        CHECK_THROWS_WITH_AS(injector.AdoptManifest(Manifest(mismatchedBytes.data(), mismatchedBytes.size()), factories),
+                             "Factory kind mismatch!", std::runtime_error);
+
+        // The bindings registered before the failing one are published.
+        ManifestWriter partial;
+        partial.Add("renderer.fast", ManifestKind::Singleton, 1);
+        partial.Add("unknown", ManifestKind::Singleton, 9);
+        auto partialBytes = partial.Build();
+        CHECK_THROWS_WITH_AS(injector.AdoptManifest(Manifest(partialBytes.data(), partialBytes.size()), factories),
+                             "Unknown factory id!", std::runtime_error);
+        CHECK(injector.ResolveSingletonTag<TestInjectableInterface>("renderer.fast")->GetA() == 1);
+    }
+}
+
+TEST_CASE("Startup tracing")
+{
+    Tracer tracer;
+    auto injector = Injector{};
+    injector.RegisterSingleton<PlainConfig>();
+    CHECK(tracer.EventCount() == 0);
+
+    injector.SetTracer(&tracer);
+    injector.RegisterSingleton<TestInjectable>();
+    injector.RegisterTransient<TestInjectable2>();
+    injector.ResolveTransient<TestInjectable2>();
+    injector.ResolveSingleton<TestInjectable>();
+    std::thread([&]()
+    {
+        injector.ResolveTransient<TestInjectable2>();
+    }).join();
+
+    // Factory and Register of the singleton, Register of the transient, two transient resolves.
+    CHECK(tracer.EventCount() == 5);
+
+    std::ostringstream output;
+    tracer.Export(output);
+    auto json = output.str();
+    CHECK(json.rfind("{\"traceEvents\":[", 0) == 0);
+    CHECK(json.find("\"name\":\"Factory\"") != std::string::npos);
+    CHECK(json.find("\"name\":\"Register\"") != std::string::npos);
+    CHECK(json.find("\"name\":\"Resolve\"") != std::string::npos);
+    CHECK(json.find("\"ph\":\"X\"") != std::string::npos);
+    CHECK(json.find("\"tid\":1") != std::string::npos);
+
+    // Placement resolves are traced through string tags as well as through tag ids.
+    injector.RegisterTransientIntoTag<PlainConfig>("placed");
+    PlainConfig storage[2];
+    injector.ResolveTransientIntoTag<PlainConfig>("placed", &storage[0], sizeof(PlainConfig));
+    injector.ResolveTransientIntoTag<PlainConfig>(injector.GetTagId("placed"), &storage[1], sizeof(PlainConfig));
+    CHECK(tracer.EventCount() == 8);
+
+    injector.SetTracer(nullptr);
+    injector.ResolveTransient<TestInjectable2>();
+    CHECK(tracer.EventCount() == 8);
+}
+
+TEST_CASE("Tagged registrations are keyed by type and signature")
+{
+    auto injector = Injector{};
+    injector.RegisterSingletonTag<TestInjectable>("default");
+    injector.RegisterSingletonTag<PlainConfig>("default");
+    injector.RegisterTransientTag<PlainConfig>("default");
+    injector.RegisterTransientTag<PlainConfig>([](int width)
+    {
+        auto config = new PlainConfig();
+        config->width = width;
+        return config;
+    }, "default");
+
+    CHECK(injector.ResolveSingletonTag<TestInjectable>("default")->a == 0);
+    CHECK(injector.ResolveSingletonTag<PlainConfig>("default")->width == 640);
+    CHECK(injector.ResolveSingletonTag<PlainConfig>("default") != injector.ResolveTransientTag<PlainConfig>("default").get());
+    CHECK(injector.ResolveTransientTag<PlainConfig>("default")->width == 640);
+    CHECK(injector.ResolveTransientTag<PlainConfig>("default", 1024)->width == 1024);
+    CHECK_THROWS_WITH_AS(injector.ResolveSingletonTag<TestInjectable2>("default"), "Singleton not registered!", std::runtime_error);
+    CHECK_THROWS_WITH_AS(injector.ResolveTransientTag<PlainConfig>("default", 1.0f), "Type not registered!", std::runtime_error);
+    CHECK_THROWS_AS(injector.RegisterSingletonTag<PlainConfig>("default"), std::runtime_error);
+    CHECK_THROWS_AS(injector.RegisterTransientTag<PlainConfig>("default"), std::runtime_error);
+}
+
+struct ShutdownLog
+{
+    static inline std::mutex mutex;
+    static inline std::vector<std::string> destroyed;
+
+    static void Add(const char* name)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        destroyed.emplace_back(name);
+    }
+
+    static std::size_t Position(const char* name)
+    {
+        for (std::size_t i = 0; i < destroyed.size(); i++)
+        {
+            if (destroyed[i] == name)
+                return i;
+        }
+        return destroyed.size();
+    }
+};
+
+struct ShutdownDatabase
+{
+    bool open = true;
+    ~ShutdownDatabase()
+    {
+        open = false;
+        ShutdownLog::Add("Database");
+    }
+};
+
+struct ShutdownCache
+{
+    ShutdownDatabase* database;
+    ~ShutdownCache()
+    {
+        CHECK(database->open);
+        ShutdownLog::Add("Cache");
+    }
+};
+
+struct ShutdownService
+{
+    ShutdownCache* cache;
+    ~ShutdownService()
+    {
+        CHECK(cache->database->open);
+        ShutdownLog::Add("Service");
+    }
+};
+
+struct ShutdownMetrics
+{
+    ~ShutdownMetrics()
+    {
+        ShutdownLog::Add("Metrics");
+    }
+};
+
+void RegisterShutdownServices(Injector& injector)
+{
+    injector.RegisterSingleton<ShutdownDatabase>();
+    injector.RegisterSingleton<ShutdownCache>([&injector]()
+    { return new ShutdownCache{injector.ResolveSingleton<ShutdownDatabase>()}; });
+    injector.RegisterSingleton<ShutdownService>([&injector]()
+    { return new ShutdownService{injector.ResolveSingleton<ShutdownCache>()}; });
+    injector.RegisterSingleton<ShutdownMetrics>();
+}
+
+TEST_CASE("Dependency ordered shutdown")
+{
+    ShutdownLog::destroyed.clear();
+
+    SUBCASE("Shutdown destroys dependents first, in waves")
+    {
+        auto injector = Injector{};
+        RegisterShutdownServices(injector);
+        auto report = injector.Shutdown(4);
+
+        REQUIRE(ShutdownLog::destroyed.size() == 4);
+        CHECK(ShutdownLog::Position("Service") < ShutdownLog::Position("Cache"));
+        CHECK(ShutdownLog::Position("Cache") < ShutdownLog::Position("Database"));
+        CHECK(ShutdownLog::Position("Metrics") < ShutdownLog::Position("Cache"));
+        CHECK(report.waves == 3);
+        REQUIRE(report.destructors.size() == 4);
+        CHECK(report.destructors[0].wave == 0);
+        CHECK(report.destructors[1].wave == 0);
+        CHECK(report.destructors[2].wave == 1);
+        CHECK(report.destructors[3].wave == 2);
+        CHECK(std::string(report.destructors[3].type) == TypeId::Name<ShutdownDatabase>());
+        CHECK(report.nanoseconds >= report.destructors[3].nanoseconds);
+        CHECK_THROWS_WITH_AS(injector.ResolveSingleton<ShutdownCache>(), "Singleton not registered!", std::runtime_error);
+        CHECK(injector.Shutdown().destructors.empty());
+    }
+
+    SUBCASE("The destructor releases in reverse construction order")
+    {
+        {
+            auto injector = Injector{};
+            RegisterShutdownServices(injector);
+        }
+        CHECK(ShutdownLog::destroyed == std::vector<std::string>{"Metrics", "Service", "Cache", "Database"});
+    }
+
+    SUBCASE("Failed registrations are not kept alive")
+    {
+        auto injector = Injector{};
+        injector.RegisterSingleton<ShutdownMetrics>();
+        CHECK_THROWS_AS(injector.RegisterSingleton<ShutdownMetrics>(), std::runtime_error);
+        CHECK(ShutdownLog::destroyed == std::vector<std::string>{"Metrics"});
+        CHECK(injector.Shutdown(1).destructors.size() == 1);
+    }
+
+    SUBCASE("References outside the Injector outlive the shutdown")
+    {
+        auto injector = Injector{};
+        injector.RegisterSharedSingleton<PlainConfig>();
+        injector.RegisterSingleton<ShutdownDatabase>();
+        auto fork = injector.Fork();
+        auto config = injector.ResolveShared<PlainConfig>();
+        injector.Shutdown();
+
+        CHECK(config->width == 640);
+        CHECK(ShutdownLog::destroyed.empty());
+        CHECK(fork.ResolveSingleton<ShutdownDatabase>()->open);
+    }
+
+    SUBCASE("A child outliving its parent releases its singletons first")
+    {
+        auto parent = std::make_unique<Injector>();
+        parent->RegisterSingleton<ShutdownDatabase>();
+        {
+            auto child = parent->CreateChild();
+            child.RegisterSingleton<ShutdownCache>([&child]()
+            { return new ShutdownCache{child.ResolveSingleton<ShutdownDatabase>()}; });
+            parent.reset();
+            CHECK(ShutdownLog::destroyed.empty());
+        }
+        CHECK(ShutdownLog::destroyed == std::vector<std::string>{"Cache", "Database"});
+    }
+
+    SUBCASE("A fork outliving the original releases dependents first")
+    {
+        auto original = std::make_unique<Injector>();
+        RegisterShutdownServices(*original);
+        {
+            auto fork = original->Fork();
+            original.reset();
+            CHECK(ShutdownLog::destroyed.empty());
+        }
+        REQUIRE(ShutdownLog::destroyed.size() == 4);
+        CHECK(ShutdownLog::Position("Service") < ShutdownLog::Position("Cache"));
+        CHECK(ShutdownLog::Position("Cache") < ShutdownLog::Position("Database"));
+    }
+
+    SUBCASE("Shutdown waits for a running async construction")
+    {
+        auto injector = Injector{};
+        injector.RegisterSingleton<ShutdownDatabase>();
+        injector.RegisterAsyncSingleton<ShutdownCache>([&injector]()
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            return new ShutdownCache{injector.ResolveSingleton<ShutdownDatabase>()};
+        });
+        injector.ResolveAsync<ShutdownCache>();
+        auto report = injector.Shutdown(2);
+
+        CHECK(ShutdownLog::destroyed == std::vector<std::string>{"Cache", "Database"});
+        CHECK(report.waves == 2);
+        REQUIRE(report.destructors.size() == 2);
+        CHECK(std::string(report.destructors[0].type) == TypeId::Name<ShutdownCache>());
+    }
+
+    SUBCASE("The destructor waits for a running async construction")
+    {
+        {
+            auto injector = Injector{};
+            injector.RegisterSingleton<ShutdownDatabase>();
+            injector.RegisterAsyncSingleton<ShutdownCache>([&injector]()
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(20));
+                return new ShutdownCache{injector.ResolveSingleton<ShutdownDatabase>()};
+            });
+            injector.RegisterSingleton<ShutdownService>([&injector]()
+            { return new ShutdownService{injector.ResolveAsync<ShutdownCache>().Get()}; });
+        }
+        CHECK(ShutdownLog::destroyed == std::vector<std::string>{"Service", "Cache", "Database"});
+    }
+
+    SUBCASE("Async singletons that never started are not waited for")
+    {
+        auto injector = Injector{};
+        injector.RegisterAsyncSingleton<ShutdownCache>([]() -> ShutdownCache*
+        { throw std::runtime_error("Not started!"); });
+        injector.RegisterAsyncSingleton<ShutdownMetrics>();
+        injector.ResolveAsync<ShutdownMetrics>().Get();
+        injector.Unregister<ShutdownMetrics>();
+        CHECK(ShutdownLog::destroyed == std::vector<std::string>{"Metrics"});
+        CHECK(injector.Shutdown(1).destructors.empty());
+    }
+}
+
+struct LeakedBuffer
+{
+    static inline int destructions = 0;
+    ShutdownDatabase* database = nullptr;
+    ~LeakedBuffer()
+    {
+        destructions++;
+    }
+};
+
+TEST_CASE("Fast shutdown")
+{
+    // Leaked instances are never deleted, so their factories hand out storage the test owns.
+    static LeakedBuffer buffers[3];
+    ShutdownLog::destroyed.clear();
+    LeakedBuffer::destructions = 0;
+
+    auto injector = Injector{};
+    injector.RegisterSingleton<ShutdownDatabase>(Teardown::Destroy);
+    injector.RegisterSingleton<LeakedBuffer>([&injector]()
+    {
+        buffers[0].database = injector.ResolveSingleton<ShutdownDatabase>();
+        return &buffers[0];
+    }, Teardown::LeakOnFastShutdown);
+    injector.RegisterSingletonTag<LeakedBuffer>([]()
+    { return &buffers[1]; }, "fast", Teardown::LeakOnFastShutdown);
+    injector.RegisterSingletonTag<LeakedBuffer>([]()
+    { return &buffers[2]; }, Quality::High, Teardown::LeakOnFastShutdown);
+    injector.RegisterSingletonTag<ShutdownMetrics>(Quality::Low, Teardown::Destroy);
+    CHECK(injector.ResolveSingletonTag<LeakedBuffer>("fast") == &buffers[1]);
+
+    auto report = injector.Shutdown(ShutdownMode::Fast, 2);
+    CHECK(LeakedBuffer::destructions == 0);
+    CHECK(ShutdownLog::destroyed == std::vector<std::string>{"Metrics", "Database"});
+    REQUIRE(report.destructors.size() == 5);
+    std::size_t leaked = 0;
+    for (const auto& destructor : report.destructors)
+        leaked += destructor.leaked ? 1 : 0;
+    CHECK(leaked == 3);
+    CHECK(report.waves == 2);
+    CHECK_THROWS_WITH_AS(injector.ResolveSingletonTag<LeakedBuffer>("fast"), "Singleton not registered!", std::runtime_error);
+}
+
+struct SwapConfig
+{
+    static inline std::atomic<int> alive{0};
+    int version;
+
+    explicit SwapConfig(int version) :
+            version(version)
+    {
+        alive++;
+    }
+
+    ~SwapConfig()
+    {
+        alive--;
+    }
+};
+
+TEST_CASE("Replacing registrations")
+{
+    SwapConfig::alive = 0;
+    auto injector = Injector{};
+
+    SUBCASE("Transient factory")
+    {
+        injector.RegisterTransient<SwapConfig>([](int version)
+        { return new SwapConfig(version); });
+        injector.Replace<SwapConfig>([](int version)
+        { return new SwapConfig(version * 10); });
+        CHECK(injector.ResolveTransient<SwapConfig>(2)->version == 20);
+        CHECK_THROWS_WITH_AS(injector.Replace<SwapConfig>([]()
+                             { return new SwapConfig(0); }), "Type not registered!", std::runtime_error);
+    }
+
+    SUBCASE("Singleton")
+    {
+        injector.RegisterSingleton<SwapConfig>([]()
+        { return new SwapConfig(1); });
+        CHECK(injector.ResolveSingleton<SwapConfig>()->version == 1);
+        injector.ReplaceSingleton<SwapConfig>([]()
+        { return new SwapConfig(2); });
+        CHECK(injector.ResolveSingleton<SwapConfig>()->version == 2);
+        CHECK(SwapConfig::alive == 1);
+        CHECK_THROWS_WITH_AS(injector.ReplaceSingleton<ShutdownMetrics>(), "Singleton not registered!", std::runtime_error);
+    }
+
+    SUBCASE("Pinned instances outlive the replacement")
+    {
+        injector.EnableReplace();
+        injector.RegisterSingleton<SwapConfig>([]()
+        { return new SwapConfig(1); });
+        {
+            auto pin = injector.Pin();
+            auto* previous = injector.ResolveSingleton<SwapConfig>();
+            injector.ReplaceSingleton<SwapConfig>([]()
+            { return new SwapConfig(2); });
+            CHECK(previous->version == 1);
+            CHECK(SwapConfig::alive == 2);
+        }
+        injector.ReplaceSingleton<SwapConfig>([]()
+        { return new SwapConfig(3); });
+        CHECK(SwapConfig::alive == 1);
+        CHECK(injector.ResolveSingleton<SwapConfig>()->version == 3);
+    }
+
+    SUBCASE("Only pins on the same Injector are waited for")
+    {
+        injector.EnableReplace();
+        injector.RegisterSingleton<SwapConfig>([]()
+        { return new SwapConfig(1); });
+        auto pin = injector.Pin();
+        {
+            auto other = Injector{};
+            other.EnableReplace();
+            other.RegisterSingleton<SwapConfig>([]()
+            { return new SwapConfig(2); });
+            other.ReplaceSingleton<SwapConfig>([]()
+            { return new SwapConfig(3); });
+            other.Shutdown();
+        }
+        CHECK(SwapConfig::alive == 1);
+        CHECK_THROWS_WITH_AS(injector.Shutdown(), "Injector is pinned by the calling thread!", std::runtime_error);
+    }
+
+    SUBCASE("Destroying an Injector the calling thread pins")
+    {
+        auto pinned = std::make_unique<Injector>();
+        pinned->EnableReplace();
+        pinned->RegisterSingleton<SwapConfig>([]()
+        { return new SwapConfig(1); });
+        auto pin = pinned->Pin();
+        pinned->ResolveSingleton<SwapConfig>();
+        pinned->ReplaceSingleton<SwapConfig>([]()
+        { return new SwapConfig(2); });
+        pinned.reset();
+        // The replaced instance goes with the retired snapshot once the thread exits.
+        CHECK(SwapConfig::alive == 1);
+    }
+
+    SUBCASE("Dependents keep the previous instance")
+    {
+        ShutdownLog::destroyed.clear();
+        RegisterShutdownServices(injector);
+        auto* cache = injector.ResolveSingleton<ShutdownCache>();
+        injector.ReplaceSingleton<ShutdownDatabase>();
+        CHECK(cache->database->open);
+        CHECK(injector.ResolveSingleton<ShutdownDatabase>() != cache->database);
+        injector.Shutdown(1);
+        // ~ShutdownCache checks that the previous database is still open.
+        REQUIRE(ShutdownLog::destroyed.size() == 5);
+        CHECK(ShutdownLog::destroyed.back() == "Database");
+    }
+
+    SUBCASE("Concurrent resolves")
+    {
+        injector.EnableReplace();
+        injector.RegisterSingleton<SwapConfig>([]()
+        { return new SwapConfig(0); });
+        injector.RegisterTransient<SwapConfig>([]()
+        { return new SwapConfig(0); });
+
+        std::atomic<bool> stop{false};
+        std::atomic<int> failures{0};
+        std::vector<std::thread> readers;
+        for (int reader = 0; reader < 4; reader++)
+        {
+            readers.emplace_back([&]()
+            {
+                int last = 0;
+                while (!stop.load())
+                {
+                    auto pin = injector.Pin();
+                    auto version = injector.ResolveSingleton<SwapConfig>()->version;
+                    if (version < last || injector.ResolveTransient<SwapConfig>()->version < 0)
+                        failures++;
+                    last = version;
+                }
+            });
+        }
+        for (int version = 1; version <= 200; version++)
+        {
+            injector.ReplaceSingleton<SwapConfig>([version]()
+            { return new SwapConfig(version); });
+            injector.Replace<SwapConfig>([version]()
+            { return new SwapConfig(version); });
+        }
+        stop = true;
+        for (auto& reader : readers)
+            reader.join();
+
+        CHECK(failures == 0);
+        CHECK(injector.ResolveSingleton<SwapConfig>()->version == 200);
+        injector.Shutdown();
+        CHECK(SwapConfig::alive == 0);
+    }
+}
+
+TEST_CASE("Unregistering registrations")
+{
+    SwapConfig::alive = 0;
+    auto injector = Injector{};
+
+    SUBCASE("Every untagged registration of a type")
+    {
+        injector.RegisterSingleton<SwapConfig>([]()
+        { return new SwapConfig(1); });
+        injector.RegisterTransient<SwapConfig>([]()
+        { return new SwapConfig(2); });
+        injector.RegisterTransient<SwapConfig>([](int version)
+        { return new SwapConfig(version); });
+        injector.RegisterSingletonTag<SwapConfig>([]()
+        { return new SwapConfig(4); }, "kept");
+        injector.RegisterSingleton<PlainConfig>();
+
+        injector.Unregister<SwapConfig>();
+        CHECK(SwapConfig::alive == 1);
+        CHECK_THROWS_WITH_AS(injector.ResolveSingleton<SwapConfig>(), "Singleton not registered!", std::runtime_error);
+        CHECK_THROWS_AS(injector.ResolveTransient<SwapConfig>(), std::runtime_error);
+        CHECK_THROWS_AS(injector.ResolveTransient<SwapConfig>(3), std::runtime_error);
+        CHECK(injector.ResolveSingletonTag<SwapConfig>("kept")->version == 4);
+        CHECK(injector.ResolveSingleton<PlainConfig>()->width == 640);
+
+        injector.RegisterSingleton<SwapConfig>([]()
+        { return new SwapConfig(5); });
+        CHECK(injector.ResolveSingleton<SwapConfig>()->version == 5);
+    }
+
+    SUBCASE("Tags")
+    {
+        injector.RegisterSingletonTag<SwapConfig>([]()
+        { return new SwapConfig(1); }, "plugin");
+        injector.RegisterTransientTag<PlainConfig>("plugin");
+        injector.RegisterTransientTag<PlainConfig>("core");
+        injector.RegisterSingletonTag<SwapConfig>([]()
+        { return new SwapConfig(2); }, Quality::High);
+
+        injector.UnregisterTag("plugin");
+        injector.UnregisterTag("unknown");
+        CHECK_THROWS_AS(injector.ResolveSingletonTag<SwapConfig>("plugin"), std::runtime_error);
+        CHECK_THROWS_AS(injector.ResolveTransientTag<PlainConfig>("plugin"), std::runtime_error);
+        CHECK(injector.ResolveTransientTag<PlainConfig>("core")->width == 640);
+
+        injector.UnregisterTag<SwapConfig>(Quality::High);
+        CHECK_THROWS_AS(injector.ResolveSingletonTag<SwapConfig>(Quality::High), std::runtime_error);
+        CHECK(SwapConfig::alive == 0);
+    }
+
+    SUBCASE("A child falls back to the parent")
+    {
+        injector.RegisterSingleton<SwapConfig>([]()
+        { return new SwapConfig(1); });
+        auto child = injector.CreateChild();
+        child.RegisterSingleton<SwapConfig>([]()
+        { return new SwapConfig(2); });
+        CHECK(child.ResolveSingleton<SwapConfig>()->version == 2);
+        child.Unregister<SwapConfig>();
+        CHECK(child.ResolveSingleton<SwapConfig>()->version == 1);
+        CHECK(SwapConfig::alive == 1);
+    }
+
+    SUBCASE("Owners")
+    {
+        auto plugin = Injector::CreateOwner();
+        injector.SetOwner(plugin);
+        injector.RegisterSingleton<SwapConfig>([]()
+        { return new SwapConfig(1); });
+        injector.RegisterTransientTag<PlainConfig>("plugin");
+        injector.RegisterSingletonTag<SwapConfig>([]()
+        { return new SwapConfig(2); }, Quality::Low);
+        injector.RegisterMulti<TestInjectableInterface, TestInjectable2>();
+        injector.SetOwner(OwnerToken{});
+        injector.RegisterMulti<TestInjectableInterface, TestInjectable2>();
+        injector.RegisterSingleton<PlainConfig>();
+
+        injector.UnregisterOwner(plugin);
+        CHECK(SwapConfig::alive == 0);
+        CHECK_THROWS_AS(injector.ResolveSingleton<SwapConfig>(), std::runtime_error);
+        CHECK_THROWS_AS(injector.ResolveTransientTag<PlainConfig>("plugin"), std::runtime_error);
+        CHECK_THROWS_AS(injector.ResolveSingletonTag<SwapConfig>(Quality::Low), std::runtime_error);
+        CHECK(injector.ResolveAll<TestInjectableInterface>().size() == 1);
+        CHECK(injector.ResolveSingleton<PlainConfig>()->width == 640);
+    }
+
+    SUBCASE("Owners only remove their own registrations")
+    {
+        auto first = Injector::CreateOwner();
+        auto second = Injector::CreateOwner();
+        injector.SetOwner(first);
+        injector.RegisterSingleton<SwapConfig>([]()
+        { return new SwapConfig(1); });
+        injector.RegisterSingletonTag<SwapConfig>([]()
+        { return new SwapConfig(1); }, Quality::Low);
+        injector.Unregister<SwapConfig>();
+        injector.UnregisterTag<SwapConfig>(Quality::Low);
+        injector.SetOwner(second);
+        injector.RegisterSingleton<SwapConfig>([]()
+        { return new SwapConfig(2); });
+        injector.RegisterSingletonTag<SwapConfig>([]()
+        { return new SwapConfig(2); }, Quality::Low);
+        injector.RegisterTransient<PlainConfig>();
+        injector.SetOwner(first);
+        injector.Replace<PlainConfig>([]()
+        { return new PlainConfig(); });
+
+        injector.UnregisterOwner(first);
+        CHECK(injector.ResolveSingleton<SwapConfig>()->version == 2);
+        CHECK(injector.ResolveSingletonTag<SwapConfig>(Quality::Low)->version == 2);
+        CHECK(injector.ResolveTransient<PlainConfig>()->width == 640);
+        injector.UnregisterOwner(second);
+        CHECK_THROWS_AS(injector.ResolveSingleton<SwapConfig>(), std::runtime_error);
+        CHECK_THROWS_AS(injector.ResolveTransient<PlainConfig>(), std::runtime_error);
+    }
+
+    SUBCASE("Compacting")
+    {
+        injector.RegisterSingleton<SwapConfig>([]()
+        { return new SwapConfig(1); });
+        injector.RegisterSingleton<PlainConfig>();
+        for (int tag = 0; tag < 100; tag++)
+            injector.RegisterTransientTag<PlainConfig>("config" + std::to_string(tag));
+        for (int tag = 0; tag < 100; tag += 2)
+            injector.UnregisterTag("config" + std::to_string(tag));
+        injector.Unregister<SwapConfig>();
+
+        injector.Compact();
+        CHECK(injector.ResolveSingleton<PlainConfig>()->width == 640);
+        CHECK(injector.ResolveTransientTag<PlainConfig>("config1")->width == 640);
+        CHECK_THROWS_AS(injector.ResolveTransientTag<PlainConfig>("config2"), std::runtime_error);
+        auto report = injector.Shutdown(1);
+        CHECK(report.destructors.size() == 1);
+    }
+}
+
+TEST_CASE("Thread local resolve cache")
+{
+    auto injector = Injector{};
+    injector.EnableResolveCache();
+    injector.RegisterSingleton<TestInjectable>();
+    injector.RegisterSingletonTag<TestInjectable>("tagged");
+    injector.RegisterTransient<PlainImplementation>([](int value)
+    { return new PlainImplementation(value); });
+
+    auto* singleton = injector.ResolveSingleton<TestInjectable>();
+    auto* tagged = injector.ResolveSingletonTag<TestInjectable>("tagged");
+    CHECK(singleton != tagged);
+    for (int i = 0; i < 3; i++)
+    {
+        CHECK(injector.ResolveSingleton<TestInjectable>() == singleton);
+        CHECK(injector.ResolveSingletonTag<TestInjectable>("tagged") == tagged);
+        CHECK(injector.ResolveTransient<PlainImplementation>(i)->value == i);
+    }
+
+    SUBCASE("Changes invalidate the cached entries")
+    {
+        injector.ReplaceSingleton<TestInjectable>();
+        CHECK(injector.ResolveSingleton<TestInjectable>() != singleton);
+        injector.Replace<PlainImplementation>([](int value)
+        { return new PlainImplementation(value + 1); });
+        CHECK(injector.ResolveTransient<PlainImplementation>(1)->value == 2);
+        injector.Unregister<TestInjectable>();
+        CHECK_THROWS_WITH_AS(injector.ResolveSingleton<TestInjectable>(), "Singleton not registered!", std::runtime_error);
+    }
+
+    SUBCASE("Injectors do not share entries")
+    {
+        auto other = Injector{};
+        other.EnableResolveCache();
+        other.RegisterSingleton<TestInjectable>();
+        CHECK(other.ResolveSingleton<TestInjectable>() != singleton);
+        CHECK(injector.ResolveSingleton<TestInjectable>() == singleton);
+
+        auto child = injector.CreateChild();
+        CHECK(child.ResolveSingleton<TestInjectable>() == singleton);
+        child.RegisterSingletonTag<TestInjectable>("child");
+        CHECK(child.ResolveSingletonTag<TestInjectable>("tagged") == tagged);
+        CHECK_THROWS_AS(injector.ResolveSingletonTag<TestInjectable>("child"), std::runtime_error);
+    }
+
+    SUBCASE("Each thread has its own cache")
+    {
+        std::vector<std::thread> threads;
+        std::atomic<int> mismatches{0};
+        for (int thread = 0; thread < 4; thread++)
+        {
+            threads.emplace_back([&]()
+            {
+                for (int i = 0; i < 1000; i++)
+                {
+                    if (injector.ResolveSingleton<TestInjectable>() != singleton)
+                        mismatches++;
+                }
+            });
+        }
+        for (auto& thread : threads)
+            thread.join();
+        CHECK(mismatches == 0);
+    }
+}
+
+struct ShardCounter
+{
+    std::atomic<long> value{0};
+};
+
+TEST_CASE("Sharded singletons")
+{
+    auto injector = Injector{};
+
+    SUBCASE("Shards are aligned and aggregated")
+    {
+        injector.RegisterSharded<ShardCounter>(4);
+        auto* shard = injector.ResolveSharded<ShardCounter>();
+        CHECK(injector.ResolveSharded<ShardCounter>() == shard);
+
+        std::vector<std::thread> threads;
+        for (int thread = 0; thread < 4; thread++)
+        {
+            threads.emplace_back([&injector]()
+            {
+                for (int i = 0; i < 1000; i++)
+                    injector.ResolveSharded<ShardCounter>()->value++;
+            });
+        }
+        for (auto& thread : threads)
+            thread.join();
+
+        long total = 0;
+        std::vector<ShardCounter*> shards;
+        injector.ForEachShard<ShardCounter>([&](ShardCounter& counter)
+        {
+            total += counter.value;
+            shards.push_back(&counter);
+        });
+        CHECK(total == 4000);
+        REQUIRE(shards.size() == 4);
+        for (std::size_t index = 0; index < shards.size(); index++)
+        {
+            CHECK(reinterpret_cast<std::uintptr_t>(shards[index]) % shardAlignment == 0);
+            if (index > 0)
+                CHECK(reinterpret_cast<char*>(shards[index]) - reinterpret_cast<char*>(shards[index - 1]) >= 128);
+        }
+    }
+
+    SUBCASE("The factory runs once per shard")
+    {
+        int calls = 0;
+        injector.RegisterSharded<PlainImplementation>([&calls]()
+        { return PlainImplementation(calls++); }, 3, ShardBy::Cpu);
+        CHECK(calls == 3);
+        auto value = injector.ResolveSharded<PlainImplementation>()->GetValue();
+        CHECK(value >= 0);
+        CHECK(value < 3);
+        CHECK_THROWS_WITH_AS(injector.RegisterSharded<PlainImplementation>([]()
+                             { return PlainImplementation(0); }), "Type already registered!", std::runtime_error);
+
+        injector.Unregister<PlainImplementation>();
+        CHECK_THROWS_WITH_AS(injector.ResolveSharded<PlainImplementation>(), "Type not registered!", std::runtime_error);
+        CHECK_THROWS_WITH_AS(injector.ForEachShard<PlainImplementation>([](PlainImplementation&)
+                             {}), "Type not registered!", std::runtime_error);
+    }
+}
+
 
 #endif //LIIINJECTOR_INJECTORTESTS_HPP
@@ -0,0 +1,17 @@
+# Prints the text size of the CodeSize benchmark per 100 registered types.
+# Usage: cmake -DSIZE_TOOL=size -DBASELINE=<binary with 0 types> -DMEASURED=<binary with 100 types> -P CodeSize.cmake
+function(text_size binary result)
+    execute_process(COMMAND ${SIZE_TOOL} ${binary} OUTPUT_VARIABLE output RESULT_VARIABLE failed)
+    if(failed)
+        message(FATAL_ERROR "${SIZE_TOOL} failed on ${binary}")
+    endif()
+    string(REGEX MATCH "\n[ \t]*([0-9]+)" match "${output}")
+    set(${result} ${CMAKE_MATCH_1} PARENT_SCOPE)
+endfunction()
+
+text_size(${BASELINE} baseline)
+text_size(${MEASURED} measured)
+math(EXPR perHundred "${measured} - ${baseline}")
+message("text size with 0 types: ${baseline} bytes")
+message("text size with 100 types: ${measured} bytes")
+message("text size per 100 registered types: ${perHundred} bytes")
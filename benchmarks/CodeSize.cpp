@@ -0,0 +1,50 @@
+// Registers and resolves LII_BENCHMARK_TYPES distinct types as singletons and transients, so comparing the
+// text size of two builds with a different type count gives the code each registered type costs.
+#include <cstdio>
+#include <memory>
+#include <utility>
+#include "Injector.hpp"
+
+#ifndef LII_BENCHMARK_TYPES
+#define LII_BENCHMARK_TYPES 100
+#endif
+
+using namespace LiiInjector;
+
+template<int N>
+struct Service
+{
+    int value = N;
+};
+
+template<int N>
+struct Product
+{
+    int value;
+
+    explicit Product(int value) : value(value)
+    {
+    }
+};
+
+template<int N>
+int Use(Injector& injector)
+{
+    injector.RegisterSingleton<Service<N>>();
+    injector.RegisterTransient<Product<N>>([](int value)
+    { return new Product<N>(value); });
+    return injector.ResolveSingleton<Service<N>>()->value + injector.ResolveTransient<Product<N>>(N)->value;
+}
+
+template<int ... N>
+int UseAll(Injector& injector, std::integer_sequence<int, N...>)
+{
+    return (0 + ... + Use<N>(injector));
+}
+
+int main()
+{
+    Injector injector;
+    std::printf("%d\n", UseAll(injector, std::make_integer_sequence<int, LII_BENCHMARK_TYPES>()));
+    return 0;
+}
@@ -0,0 +1,46 @@
+// Runs a compiler command and prints its wall time and peak memory.
+#include <chrono>
+#include <cstdio>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        std::fprintf(stderr, "Usage: %s <compiler> <arguments...>\n", argv[0]);
+        return 2;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    pid_t child = fork();
+    if (child == 0)
+    {
+        execvp(argv[1], argv + 1);
+        _exit(127);
+    }
+
+    int status = 0;
+    rusage usage{};
+    if (child < 0 || wait4(child, &status, 0, &usage) < 0)
+    {
+        std::perror("wait4");
+        return 1;
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+    {
+        std::fprintf(stderr, "Compilation failed\n");
+        return 1;
+    }
+
+    // ru_maxrss is in kilobytes on Linux and in bytes on macOS.
+#ifdef __APPLE__
+    auto peakMegabytes = static_cast<double>(usage.ru_maxrss) / (1024.0 * 1024.0);
+#else
+    auto peakMegabytes = static_cast<double>(usage.ru_maxrss) / 1024.0;
+#endif
+    std::printf("build time: %.2f s, peak memory: %.1f MB\n", elapsed.count(), peakMegabytes);
+    return 0;
+}
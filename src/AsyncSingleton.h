@@ -0,0 +1,238 @@
+#ifndef LIIINJECTOR_ASYNCSINGLETON_H
+#define LIIINJECTOR_ASYNCSINGLETON_H
+
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+#include <coroutine>
+#define LII_INJECTOR_COROUTINES
+#endif
+#include "Injector.hpp"
+
+namespace LiiInjector
+{
+    template<class T>
+    struct IsFuture : std::false_type
+    {
+    };
+
+    template<class T>
+    struct IsFuture<std::future<T>> : std::true_type
+    {
+    };
+
+    // Singleton constructed on its own thread on first resolve. Every resolver shares that one construction. The
+    // registering Injector tracks it as a PendingSingleton, so Shutdown and the destructor wait for a running
+    // construction and release the instance in dependency order.
+    class AsyncSingleton : public PendingSingleton
+    {
+    private:
+        std::function<InstanceSlot()> factoryFunc;
+        std::once_flag started;
+        std::thread thread;
+        std::mutex mutex;
+        std::condition_variable constructed;
+        bool running = false;
+        bool ready = false;
+        std::shared_ptr<InstanceSlot> instance;
+        std::exception_ptr error;
+#ifdef LII_INJECTOR_COROUTINES
+        std::vector<std::coroutine_handle<>> awaiters;
+#endif
+
+        void Construct()
+        {
+            std::shared_ptr<InstanceSlot> result;
+            std::exception_ptr failure;
+            try
+            {
+                // Singletons the factory resolves outlive the instance.
+                ConstructionScope construction;
+                result = std::make_shared<InstanceSlot>(factoryFunc());
+                result->Depend(std::move(construction.Dependencies()));
+            }
+            catch (...)
+            {
+                failure = std::current_exception();
+            }
+
+            std::unique_lock lock(mutex);
+            instance = std::move(result);
+            error = failure;
+            ready = true;
+#ifdef LII_INJECTOR_COROUTINES
+            auto resumed = std::move(awaiters);
+            awaiters.clear();
+#endif
+            lock.unlock();
+            constructed.notify_all();
+#ifdef LII_INJECTOR_COROUTINES
+            // Awaiters continue on the construction thread.
+            for (auto awaiter : resumed)
+                awaiter.resume();
+#endif
+        }
+    public:
+        AsyncSingleton(std::function<InstanceSlot()> factoryFunc, const char* typeName) :
+                PendingSingleton(typeName), factoryFunc(std::move(factoryFunc))
+        {
+        }
+
+        AsyncSingleton(const AsyncSingleton&) = delete;
+        AsyncSingleton& operator=(const AsyncSingleton&) = delete;
+
+        // The thread holds no reference, so the instance goes with the last holder outside of it. Only an awaiter
+        // resumed on the thread can drop the last reference there, the thread no longer touches the object then.
+        ~AsyncSingleton() override
+        {
+            if (!thread.joinable())
+                return;
+            if (thread.get_id() == std::this_thread::get_id())
+                thread.detach();
+            else
+                thread.join();
+        }
+
+        void Start()
+        {
+            std::call_once(started, [this]()
+            {
+                {
+                    std::lock_guard lock(mutex);
+                    running = true;
+                }
+                thread = std::thread([this]()
+                { Construct(); });
+            });
+        }
+
+        std::shared_ptr<InstanceSlot> Finish() override
+        {
+            std::unique_lock lock(mutex);
+            if (!running)
+                return nullptr;
+            constructed.wait(lock, [this]()
+            { return ready; });
+            return instance;
+        }
+
+        bool Ready()
+        {
+            std::lock_guard lock(mutex);
+            return ready;
+        }
+
+        // Blocks until the construction finished and rethrows the factory's exception if it failed.
+        InstanceSlot& Wait()
+        {
+            Start();
+            std::unique_lock lock(mutex);
+            constructed.wait(lock, [this]()
+            { return ready; });
+            if (error)
+                std::rethrow_exception(error);
+            return *instance;
+        }
+
+#ifdef LII_INJECTOR_COROUTINES
+        // Returns false when the construction already finished and the awaiter should not suspend.
+        bool Suspend(std::coroutine_handle<> awaiter)
+        {
+            Start();
+            std::lock_guard lock(mutex);
+            if (ready)
+                return false;
+            awaiters.push_back(awaiter);
+            return true;
+        }
+#endif
+    };
+
+
+    // Result of ResolveAsync. Get blocks, in C++20 it can also be co_awaited.
+    template<class T>
+    class AsyncResolve
+    {
+    private:
+        std::shared_ptr<AsyncSingleton> singleton;
+    public:
+        explicit AsyncResolve(std::shared_ptr<AsyncSingleton> singleton) :
+                singleton(std::move(singleton))
+        {
+        }
+
+        T* Get() const
+        {
+            auto& slot = singleton->Wait();
+            auto* result = slot.template Get<T>();
+            if (result == nullptr)
+                ThrowError("Type mismatch!");
+            ConstructionScope::Resolved(slot);
+            return result;
+        }
+
+        bool Ready() const
+        {
+            return singleton->Ready();
+        }
+
+#ifdef LII_INJECTOR_COROUTINES
+        bool await_ready() const
+        {
+            return singleton->Ready();
+        }
+
+        bool await_suspend(std::coroutine_handle<> awaiter) const
+        {
+            return singleton->Suspend(awaiter);
+        }
+
+        T* await_resume() const
+        {
+            return Get();
+        }
+#endif
+    };
+
+
+    template<typename T, typename F>
+    void Injector::RegisterAsyncSingleton(const F& factoryFunction)
+    {
+        auto registration = std::make_shared<AsyncSingleton>([factoryFunction]()
+        {
+            if constexpr (IsFuture<decltype(factoryFunction())>::value)
+                return InstanceSlot::Adopt<T>(factoryFunction().get());
+            else
+                return InstanceSlot::Adopt<T>(factoryFunction());
+        }, TypeId::Name<T>());
+        Insert(&Registry::asyncSingletons, TypeId::Of<T>(), registration, "Type already registered!");
+        graph.Track(std::move(registration));
+    }
+
+    template<typename T>
+    void Injector::RegisterAsyncSingleton()
+    {
+        RegisterAsyncSingleton<T>([]()
+        { return new T(); });
+    }
+
+    template<class T>
+    AsyncResolve<T> Injector::ResolveAsync()
+    {
+        auto pin = Guard();
+        auto* entry = View().asyncSingletons.Find(TypeId::Of<T>());
+        if (entry == nullptr)
+            ThrowError("Type not registered!");
+        (*entry)->Start();
+        return AsyncResolve<T>(*entry);
+    }
+}
+
+#endif //LIIINJECTOR_ASYNCSINGLETON_H
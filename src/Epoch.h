@@ -0,0 +1,191 @@
+#ifndef LIIINJECTOR_EPOCH_H
+#define LIIINJECTOR_EPOCH_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+#ifdef _WIN32
+// Declared like processthreadsapi.h does, windows.h would hand its macros to every includer.
+extern "C" __declspec(dllimport) int __stdcall SwitchToThread();
+#else
+#include <sched.h>
+#endif
+
+namespace LiiInjector
+{
+    // Small number of the calling thread, numbers are handed out in the order threads first ask for one.
+    inline std::size_t ThreadIndex()
+    {
+        static std::atomic<std::size_t> counter{0};
+        thread_local std::size_t index = counter.fetch_add(1, std::memory_order_relaxed);
+        return index;
+    }
+
+    // Lets other threads run while a writer waits for readers, without pulling <thread> into every includer.
+    inline void YieldThread()
+    {
+#ifdef _WIN32
+        SwitchToThread();
+#else
+        sched_yield();
+#endif
+    }
+
+
+    // Epoch based reclamation for the data one writer publishes. Readers pin the domain while they use published
+    // data, the writer retires what it unpublished and a later Collect frees it once no reader that could still
+    // see it is pinned. Readers count themselves in one of two counter sets, spread over cache line sized shards.
+    // Collect flips the active set and frees what was retired before the flip once the other set drained, so it
+    // never waits for readers, and readers never wait at all.
+    class EpochDomain
+    {
+    private:
+        struct alignas(128) Shard
+        {
+            std::atomic<std::int64_t> readers[2]{};
+        };
+
+        std::unique_ptr<Shard[]> shards;
+        // A power of two, so picking a shard is a mask.
+        std::size_t count;
+        std::atomic<std::uint32_t> active{0};
+        // Retired since the last flip.
+        std::vector<std::shared_ptr<const void>> retired;
+        // Retired before the last flip, freed once the set that was active before it drained.
+        std::vector<std::shared_ptr<const void>> draining;
+
+        static std::size_t ShardCount(std::size_t threads)
+        {
+            std::size_t count = 1;
+            while (count < threads)
+                count *= 2;
+            return count;
+        }
+
+        bool Drained(std::uint32_t set) const
+        {
+            for (std::size_t index = 0; index < count; index++)
+            {
+                if (shards[index].readers[set].load() != 0)
+                    return false;
+            }
+            return true;
+        }
+    public:
+        // threads is the number of threads expected to pin the domain at once, more of them share counters.
+        explicit EpochDomain(std::size_t threads = 32) :
+                count(ShardCount(threads))
+        {
+            shards.reset(new Shard[count]);
+        }
+
+        // Returns the counter to pass to Leave.
+        std::atomic<std::int64_t>* Enter()
+        {
+            auto& shard = shards[ThreadIndex() & (count - 1)];
+            while (true)
+            {
+                auto set = active.load();
+                auto& readers = shard.readers[set];
+                readers.fetch_add(1);
+                // Collect may have flipped in between and already seen this set drained.
+                if (active.load() == set)
+                    return &readers;
+                readers.fetch_sub(1);
+            }
+        }
+
+        static void Leave(std::atomic<std::int64_t>* readers)
+        {
+            readers->fetch_sub(1, std::memory_order_release);
+        }
+
+        // Call after the object was unpublished, on the writer's thread.
+        void Retire(std::shared_ptr<const void> object)
+        {
+            retired.push_back(std::move(object));
+        }
+
+        // Frees what no reader can see any more. Returns whether everything retired so far is freed.
+        bool Collect()
+        {
+            if (!draining.empty())
+            {
+                if (!Drained(active.load() ^ 1))
+                    return false;
+                draining.clear();
+            }
+            if (retired.empty())
+                return true;
+            draining.swap(retired);
+            active.store(active.load() ^ 1);
+            if (!Drained(active.load() ^ 1))
+                return false;
+            draining.clear();
+            return true;
+        }
+    };
+
+
+    // Keeps domain, and what was retired to it, until the calling thread exits. For a domain whose owner goes away
+    // while the calling thread still pins it, so the guard can leave it later.
+    inline void KeepUntilThreadExit(std::unique_ptr<EpochDomain> domain)
+    {
+        thread_local std::vector<std::unique_ptr<EpochDomain>> kept;
+        kept.push_back(std::move(domain));
+    }
+
+
+    // Pins a domain for its lifetime. Guards are destroyed on the thread that created them, in reverse order. A
+    // guard constructed with nullptr does nothing.
+    class EpochGuard
+    {
+    private:
+        EpochDomain* domain;
+        std::atomic<std::int64_t>* readers = nullptr;
+        const EpochGuard* previous = nullptr;
+
+        static const EpochGuard*& Innermost()
+        {
+            thread_local const EpochGuard* guard = nullptr;
+            return guard;
+        }
+    public:
+        explicit EpochGuard(EpochDomain* domain) :
+                domain(domain)
+        {
+            if (domain == nullptr)
+                return;
+            readers = domain->Enter();
+            previous = std::exchange(Innermost(), this);
+        }
+
+        // Not movable, the guards of a thread form a list through their addresses.
+        EpochGuard(const EpochGuard&) = delete;
+        EpochGuard& operator=(const EpochGuard&) = delete;
+
+        ~EpochGuard()
+        {
+            if (domain == nullptr)
+                return;
+            Innermost() = previous;
+            EpochDomain::Leave(readers);
+        }
+
+        // Whether the calling thread holds a guard on domain, waiting for its readers would never end then.
+        static bool Held(const EpochDomain* domain)
+        {
+            for (auto* guard = Innermost(); guard != nullptr; guard = guard->previous)
+            {
+                if (guard->domain == domain)
+                    return true;
+            }
+            return false;
+        }
+    };
+}
+
+#endif //LIIINJECTOR_EPOCH_H
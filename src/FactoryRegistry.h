@@ -0,0 +1,65 @@
+#ifndef LIIINJECTOR_FACTORYREGISTRY_H
+#define LIIINJECTOR_FACTORYREGISTRY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include "Injector.hpp"
+#include "Manifest.h"
+
+namespace LiiInjector
+{
+    // Factories that manifests refer to by id. Each id is bound to one kind, singleton or transient.
+    class FactoryRegistry
+    {
+    private:
+        struct Factory
+        {
+            ManifestKind kind;
+            std::function<void(Injector&, TagId)> bind;
+        };
+
+        PersistentMap<std::uint32_t, Factory> factories;
+
+        void Add(std::uint32_t factoryId, ManifestKind kind, std::function<void(Injector&, TagId)> bind)
+        {
+            if (!factories.Insert(factoryId, Factory{kind, std::move(bind)}))
+                ThrowError("Factory id already registered!");
+        }
+    public:
+        template<typename T, typename F>
+        [[maybe_unused]] void AddSingleton(std::uint32_t factoryId, const F& factoryFunction)
+        {
+            Add(factoryId, ManifestKind::Singleton, [factoryFunction](Injector& injector, TagId tag)
+            { injector.RegisterSingletonTag<T>(factoryFunction, tag); });
+        }
+
+        template<typename T, typename F>
+        [[maybe_unused]] void AddTransient(std::uint32_t factoryId, const F& factoryLambda)
+        {
+            Add(factoryId, ManifestKind::Transient, [factoryLambda](Injector& injector, TagId tag)
+            { injector.RegisterTransientTag<T>(factoryLambda, tag); });
+        }
+
+        void Bind(Injector& injector, const ManifestEntry& entry, TagId tag) const
+        {
+            auto* factory = factories.Find(entry.factoryId);
+            if (factory == nullptr)
+                ThrowError("Unknown factory id!");
+            if (factory->kind != entry.kind)
+                ThrowError("Factory kind mismatch!");
+            factory->bind(injector, tag);
+        }
+    };
+
+    inline void Injector::AdoptManifest(const Manifest& manifest, const FactoryRegistry& factories)
+    {
+        Batch([&]()
+        {
+            for (const auto& entry : manifest)
+                factories.Bind(*this, entry, InternTag(manifest.Name(entry), static_cast<std::size_t>(entry.hash)));
+        });
+    }
+}
+
+#endif //LIIINJECTOR_FACTORYREGISTRY_H
@@ -6,232 +6,2458 @@
 #define LIIINJECTOR_INJECTOR_HPP
 
 #include <string>
+#include <string_view>
+#include <array>
+#include <cstring>
+#include <utility>
 #include <memory>
-#include <unordered_map>
 #include <stdexcept>
-#include <typeindex>
 #include <functional>
+#include <vector>
+#include <cstdint>
+#include <atomic>
+#include <type_traits>
+#include <new>
+#include <tuple>
+#include <algorithm>
+#include <iterator>
 #include "Injectable.h"
+#include "SharedHandle.h"
+#include "PersistentMap.h"
+#include "TraceSink.h"
+#include "Epoch.h"
+
+#if defined(__GNUC__) || defined(__clang__)
+#define LII_INJECTOR_NOINLINE __attribute__((noinline))
+#define LII_INJECTOR_COLD __attribute__((noinline, cold))
+#elif defined(_MSC_VER)
+#define LII_INJECTOR_NOINLINE __declspec(noinline)
+#define LII_INJECTOR_COLD __declspec(noinline)
+#else
+#define LII_INJECTOR_NOINLINE
+#define LII_INJECTOR_COLD
+#endif
 
 namespace LiiInjector
 {
+    // Every error is thrown from here, so the throw code is compiled once instead of in every instantiation.
+    [[noreturn]] LII_INJECTOR_COLD inline void ThrowError(const char* message)
+    {
+        throw std::runtime_error(message);
+    }
+
+
+    // Id per type, a hash of the name the compiler gives the type, so every module of the process agrees on it,
+    // plugins built with hidden visibility included. Does not need RTTI. Ids are only hashes, code that casts on a
+    // matching id compares the names as well, see Is. Types without linkage may share a name, e.g. two anonymous
+    // namespace types of different files, so their ids also depend on where the module keeps their name.
+    class TypeId
+    {
+    private:
+        template<class T>
+        static constexpr std::string_view FunctionName()
+        {
+#if defined(_MSC_VER) && !defined(__clang__)
+            return __FUNCSIG__;
+#else
+            return __PRETTY_FUNCTION__;
+#endif
+        }
+
+        // The text around the type name is measured on a type whose name is known.
+        template<class T>
+        static constexpr std::string_view NameOf()
+        {
+            constexpr auto probe = FunctionName<double>();
+            constexpr auto prefix = probe.find("double");
+            constexpr auto suffix = probe.size() - prefix - std::string_view("double").size();
+            auto signature = FunctionName<T>();
+            return signature.substr(prefix, signature.size() - prefix - suffix);
+        }
+
+        template<class T, std::size_t ... Index>
+        static constexpr std::array<char, sizeof...(Index) + 1> Terminated(std::index_sequence<Index...>)
+        {
+            return {NameOf<T>()[Index]..., '\0'};
+        }
+
+        static constexpr std::uint64_t Hash(std::string_view name)
+        {
+            std::uint64_t hash = 0xCBF29CE484222325ull;
+            for (auto character : name)
+            {
+                hash ^= static_cast<unsigned char>(character);
+                hash *= 0x100000001B3ull;
+            }
+            return hash;
+        }
+
+        static constexpr bool HasLinkage(std::string_view name)
+        {
+            for (std::string_view marker : {"{anonymous}", "anonymous namespace", "<lambda", "(lambda", "<unnamed",
+                                            "(unnamed", ")::", "'::"})
+            {
+                if (name.find(marker) != std::string_view::npos)
+                    return false;
+            }
+            return true;
+        }
+
+        template<class T>
+        struct Info
+        {
+            static constexpr auto name = Terminated<T>(std::make_index_sequence<NameOf<T>().size()>());
+            static constexpr std::uint64_t hash = Hash(NameOf<T>());
+        };
+
+        // Names only differ in address when they come from different modules.
+        LII_INJECTOR_NOINLINE static bool SameName(const char* first, const char* second)
+        {
+            return std::strcmp(first, second) == 0;
+        }
+    public:
+        template<class T>
+        static std::uint64_t Of()
+        {
+            if constexpr (HasLinkage(NameOf<T>()))
+                return Info<T>::hash;
+            else
+                return Info<T>::hash ^ reinterpret_cast<std::uintptr_t>(Info<T>::name.data());
+        }
+
+        // The name of T as the compiler spells it, e.g. for traces and reports.
+        template<class T>
+        static constexpr const char* Name()
+        {
+            return Info<T>::name.data();
+        }
+
+        // Whether name, taken from Name, names T. Used on entries found by the id of T before they are cast.
+        template<class T>
+        static bool Is(const char* name)
+        {
+            return name == Name<T>() || SameName(name, Name<T>());
+        }
+    };
+
+
+    // Describes how a type erased instance is cast and destroyed. Instances are stored as a pointer to
+    // the type they were registered for, or as Injectable* when a legacy factory returned an Injectable.
+    struct ErasedType
+    {
+        std::uint64_t typeId = 0;
+        const char* typeName = nullptr;
+        void (*destroy)(void*) = nullptr;
+        Injectable* (*toInjectable)(void*) = nullptr;
+
+        // The type an R* returned by a factory registered for T is stored as.
+        template<class T, class R>
+        using Stored = std::conditional_t<std::is_convertible<R*, T*>::value, T, R>;
+
+        template<class T>
+        static ErasedType Of()
+        {
+            ErasedType type;
+            type.typeId = TypeId::Of<T>();
+            type.typeName = TypeId::Name<T>();
+            type.destroy = [](void* instance)
+            { delete static_cast<T*>(instance); };
+            if constexpr (std::is_base_of<Injectable, T>::value)
+                type.toInjectable = [](void* instance) -> Injectable*
+                { return static_cast<T*>(instance); };
+            return type;
+        }
+
+        template<class T, class R>
+        static ErasedType OfProduct()
+        {
+            static_assert(std::is_convertible<R*, T*>::value ||
+                          (std::is_same<R, Injectable>::value && std::is_base_of<Injectable, T>::value),
+                          "Factory must return T, a child of T or an Injectable");
+            static_assert(!std::is_convertible<R*, T*>::value || std::is_same<R, T>::value ||
+                          std::has_virtual_destructor<T>::value,
+                          "T must have a virtual destructor to own a child of T");
+            return Of<Stored<T, R>>();
+        }
+
+        template<class T>
+        T* Cast(void* instance) const
+        {
+            if (typeId == TypeId::Of<T>() && TypeId::Is<T>(typeName))
+                return static_cast<T*>(instance);
+            if constexpr (std::is_base_of<Injectable, T>::value)
+                return CastInjectable<T>(instance);
+            else
+                return nullptr;
+        }
+
+        // Outlined, only products of factories returning Injectable* take this path.
+        template<class T>
+        LII_INJECTOR_NOINLINE T* CastInjectable(void* instance) const
+        {
+            if (toInjectable == nullptr)
+                return nullptr;
+            return dynamic_cast<T*>(toInjectable(instance));
+        }
+    };
+
+
+    // Owns a single instance of any type, or one strong reference to a shared instance. A singleton slot also holds
+    // the singletons its factory resolved, so they outlive it whichever Injector drops its last reference.
+    class InstanceSlot : public std::enable_shared_from_this<InstanceSlot>
+    {
+    private:
+        void* instance = nullptr;
+        SharedBlockBase* shared = nullptr;
+        ErasedType type;
+        std::vector<std::shared_ptr<const InstanceSlot>> dependencies;
+
+        void Reset()
+        {
+            if (shared != nullptr)
+                shared->ReleaseStrong();
+            else if (instance != nullptr)
+                type.destroy(instance);
+            instance = nullptr;
+            shared = nullptr;
+        }
+    public:
+        InstanceSlot() = default;
+        InstanceSlot(const InstanceSlot&) = delete;
+        InstanceSlot& operator=(const InstanceSlot&) = delete;
+
+        InstanceSlot(InstanceSlot&& other) noexcept :
+                instance(other.instance), shared(other.shared), type(other.type),
+                dependencies(std::move(other.dependencies))
+        {
+            other.instance = nullptr;
+            other.shared = nullptr;
+        }
+
+        InstanceSlot& operator=(InstanceSlot&& other) noexcept
+        {
+            if (this != &other)
+            {
+                Reset();
+                instance = other.instance;
+                shared = other.shared;
+                type = other.type;
+                dependencies = std::move(other.dependencies);
+                other.instance = nullptr;
+                other.shared = nullptr;
+            }
+            return *this;
+        }
+
+        ~InstanceSlot()
+        {
+            Reset();
+        }
+
+        template<class T, class R>
+        static InstanceSlot Adopt(R* instance)
+        {
+            InstanceSlot slot;
+            slot.type = ErasedType::OfProduct<T, R>();
+            slot.instance = static_cast<ErasedType::Stored<T, R>*>(instance);
+            return slot;
+        }
+
+        template<class T, class R>
+        static InstanceSlot Adopt(std::unique_ptr<R> instance)
+        {
+            return Adopt<T>(instance.release());
+        }
+
+        template<class T, class Impl>
+        static InstanceSlot AdoptShared(SharedBlock<Impl>* block)
+        {
+            InstanceSlot slot;
+            slot.type = ErasedType::OfProduct<T, Impl>();
+            slot.instance = static_cast<T*>(&block->instance);
+            slot.shared = block;
+            return slot;
+        }
+
+        template<class T>
+        T* Get() const
+        {
+            return type.Cast<T>(instance);
+        }
+
+        template<class T>
+        SharedHandle<T> GetShared() const
+        {
+            if (shared == nullptr)
+                ThrowError("Singleton is not shared!");
+            auto* result = Get<T>();
+            if (result == nullptr)
+                ThrowError("Singleton type mismatch!");
+            shared->AddStrong();
+            return SharedHandle<T>(shared, result);
+        }
+
+        void Depend(std::vector<std::shared_ptr<const InstanceSlot>> dependencies)
+        {
+            this->dependencies = std::move(dependencies);
+        }
+
+        const std::vector<std::shared_ptr<const InstanceSlot>>& Dependencies() const
+        {
+            return dependencies;
+        }
+
+        // Forgets the instance without destroying it, its memory is left to the operating system.
+        void Leak()
+        {
+            instance = nullptr;
+            shared = nullptr;
+        }
+
+        explicit operator bool() const
+        {
+            return instance != nullptr;
+        }
+    };
+
+
+    // Compile time key of a factory producing T from Args.
+    template<class T, class ... Args>
+    struct Signature final
+    {
+    };
+
+
+    template<class ... Args>
+    class FunctionWrapper;
+
     class FunctionWrapperBase
     {
     public:
         virtual ~FunctionWrapperBase() = default;
+
+        std::uint64_t signatureId = 0;
+        // Id and name of the wrapper class.
+        std::uint64_t argumentsId = 0;
+        const char* argumentsName = nullptr;
+        // The registered type.
+        std::uint64_t typeId = 0;
+        ErasedType productType;
+
+        template<class Wrapper>
+        Wrapper* To()
+        {
+            if (argumentsId != TypeId::Of<Wrapper>() || !TypeId::Is<Wrapper>(argumentsName))
+                return nullptr;
+            return static_cast<Wrapper*>(this);
+        }
+
+        template<class ... Args>
+        FunctionWrapper<Args...>* As()
+        {
+            return To<FunctionWrapper<Args...>>();
+        }
+
+        template<class T>
+        std::unique_ptr<T> Cast(void* product) const
+        {
+            auto* result = productType.Cast<T>(product);
+            if (result == nullptr)
+                Mismatch(product);
+            return std::unique_ptr<T>(result);
+        }
+
+        [[noreturn]] LII_INJECTOR_COLD void Mismatch(void* product) const
+        {
+            productType.destroy(product);
+            ThrowError("Type mismatch!");
+        }
+    };
+
+
+    template<class ... Args>
+    class FunctionWrapper : public FunctionWrapperBase
+    {
+    public:
+        ~FunctionWrapper() override = default;
+        template<class T>
+        static std::uint64_t GetTypeSignature()
+        {
+            return TypeId::Of<Signature<T, Args...>>();
+        }
+
+        template<class T, class R, class F>
+        static FunctionWrapper* Create(const F& factoryLambda)
+        {
+            auto* functionWrapper = new FunctionWrapper();
+            functionWrapper->signatureId = GetTypeSignature<T>();
+            functionWrapper->argumentsId = TypeId::Of<FunctionWrapper>();
+            functionWrapper->argumentsName = TypeId::Name<FunctionWrapper>();
+            functionWrapper->typeId = TypeId::Of<T>();
+            functionWrapper->productType = ErasedType::OfProduct<T, R>();
+            functionWrapper->factoryFunc = [factoryLambda](Args ... args) -> void*
+            {
+                return static_cast<ErasedType::Stored<T, R>*>(factoryLambda(std::forward<Args>(args)...));
+            };
+            return functionWrapper;
+        }
+
+        std::function<void*(Args...)> factoryFunc;
+    };
+
+
+    // Size and alignment a placement registration needs from the caller's storage.
+    struct StorageLayout
+    {
+        std::size_t size;
+        std::size_t alignment;
+    };
+
+
+    // Factory that constructs its product in storage owned by the caller.
+    template<class ... Args>
+    class PlacementFunctionWrapper : public FunctionWrapperBase
+    {
+    public:
+        ~PlacementFunctionWrapper() override = default;
+
+        template<class T>
+        static std::uint64_t GetTypeSignature()
+        {
+            return TypeId::Of<Signature<T, Args...>>();
+        }
+
+        template<class T, class R, class F>
+        static PlacementFunctionWrapper* Create(const F& factoryLambda)
+        {
+            static_assert(std::is_convertible<R*, T*>::value, "Placement factory must return T or a child of T");
+            auto* functionWrapper = new PlacementFunctionWrapper();
+            functionWrapper->argumentsId = TypeId::Of<PlacementFunctionWrapper>();
+            functionWrapper->argumentsName = TypeId::Name<PlacementFunctionWrapper>();
+            functionWrapper->signatureId = GetTypeSignature<T>();
+            functionWrapper->typeId = TypeId::Of<T>();
+            functionWrapper->productType = ErasedType::OfProduct<T, R>();
+            functionWrapper->layout = StorageLayout{sizeof(R), alignof(R)};
+            functionWrapper->factoryFunc = [factoryLambda](void* storage, Args ... args) -> void*
+            {
+                return static_cast<T*>(factoryLambda(storage, std::forward<Args>(args)...));
+            };
+            return functionWrapper;
+        }
+
+        template<class T>
+        T* Construct(void* storage, std::size_t size, Args ... args)
+        {
+            if (productType.typeId != TypeId::Of<T>() || !TypeId::Is<T>(productType.typeName))
+                ThrowError("Type mismatch!");
+            if (size < layout.size || reinterpret_cast<std::uintptr_t>(storage) % layout.alignment != 0)
+                ThrowError("Storage does not fit the type!");
+            return static_cast<T*>(factoryFunc(storage, std::move(args) ...));
+        }
+
+        std::function<void*(void*, Args...)> factoryFunc;
+        StorageLayout layout{0, 1};
+    };
+
+
+    // Factory that builds T by value, straight into the caller's storage.
+    template<class T, class ... Args>
+    class ValueFunctionWrapper : public FunctionWrapperBase
+    {
+    public:
+        ~ValueFunctionWrapper() override = default;
+        explicit ValueFunctionWrapper(const std::function<T(Args...)>& factoryFunc) :
+                factoryFunc(factoryFunc)
+        {
+            argumentsId = TypeId::Of<ValueFunctionWrapper>();
+            argumentsName = TypeId::Name<ValueFunctionWrapper>();
+            typeId = TypeId::Of<T>();
+        }
+
+        std::function<T(Args...)> factoryFunc;
+    };
+
+
+    template<class F, class FunctionType, class ... Decorators>
+    class Decorated;
+
+    // Factory whose product is passed through every decorator in order. The chain is a single callable, so a
+    // decorated factory costs the same single indirect call on resolve as a plain one.
+    template<class F, class R, class ... Args, class ... Decorators>
+    class Decorated<F, std::function<R(Args...)>, Decorators...>
+    {
+    private:
+        F factory;
+        std::tuple<Decorators...> decorators;
+
+        template<std::size_t Index, class P>
+        auto Apply(P&& product) const
+        {
+            if constexpr (Index == sizeof...(Decorators))
+                return std::forward<P>(product);
+            else
+                return Apply<Index + 1>(std::get<Index>(decorators)(std::forward<P>(product)));
+        }
+    public:
+        explicit Decorated(F factory, Decorators ... decorators) :
+                factory(std::move(factory)), decorators(std::move(decorators)...)
+        {
+        }
+
+        // Not a template, the Register functions deduce the factory arguments from it.
+        auto operator()(Args ... args) const
+        {
+            return Apply<0>(factory(std::forward<Args>(args)...));
+        }
+    };
+
+    // Each decorator takes the product of the previous step and returns the object that replaces it, for example
+    // a proxy that owns it. The result can be passed to any Register function that takes a factory.
+    template<class F, class ... Decorators>
+    auto Decorate(F factory, Decorators ... decorators)
+    {
+        using FunctionType = decltype(std::function{factory});
+        return Decorated<F, FunctionType, Decorators...>(std::move(factory), std::move(decorators)...);
+    }
+
+
+    // Dense id of an interned tag. Children and forks keep the ids their Injector interned before they were
+    // created, ids interned later belong to the Injector that interned them and mean nothing to any other.
+    struct TagId
+    {
+        std::uint32_t value;
+    };
+
+    // FNV-1a like ManifestHash, so the hashes a manifest stores for its tags can intern them.
+    struct TagHash
+    {
+        std::size_t operator()(std::string_view tag) const
+        {
+            std::uint64_t hash = 14695981039346656037ull;
+            for (char character : tag)
+            {
+                hash ^= static_cast<unsigned char>(character);
+                hash *= 1099511628211ull;
+            }
+            return static_cast<std::size_t>(hash);
+        }
+    };
+
+    // Groups the registrations made after Injector::SetOwner, so UnregisterOwner can remove them together.
+    // Tokens from Injector::CreateOwner are unique in the process, the default token owns nothing.
+    struct OwnerToken
+    {
+        std::uint32_t value = 0;
+    };
+
+
+    // How ResolveSharded picks the shard. Threads are numbered in the order of their first sharded resolve.
+    // Cpu falls back to Thread where the current processor can not be queried.
+    enum class ShardBy
+    {
+        Thread,
+        Cpu
+    };
+
+    // Defined in ThreadLocal.h, Sharded.h, Recycled.h and AsyncSingleton.h, together with the Injector members
+    // that use them.
+    class ThreadLocalRegistration;
+    class ShardedBase;
+    class RecycledRegistrationBase;
+
+    template<class T>
+    class Recycler;
+
+    template<class T>
+    using Recycled = std::unique_ptr<T, Recycler<T>>;
+
+    class AsyncSingleton;
+
+    template<class T>
+    class AsyncResolve;
+
+
+    // Contiguous read only view, std::span is not available in C++17.
+    template<class T>
+    class Span
+    {
+    private:
+        T* first = nullptr;
+        std::size_t count = 0;
+    public:
+        Span() = default;
+
+        Span(T* first, std::size_t count) :
+                first(first), count(count)
+        {
+        }
+
+        T* begin() const
+        {
+            return first;
+        }
+
+        T* end() const
+        {
+            return first + count;
+        }
+
+        T* data() const
+        {
+            return first;
+        }
+
+        T& operator[](std::size_t index) const
+        {
+            return first[index];
+        }
+
+        std::size_t size() const
+        {
+            return count;
+        }
+
+        bool empty() const
+        {
+            return count == 0;
+        }
+    };
+
+
+    class MultiBindingBase
+    {
+    public:
+        explicit MultiBindingBase(const char* typeName) :
+                typeName(typeName)
+        {
+        }
+
+        virtual ~MultiBindingBase() = default;
+
+        // TypeId::Name of T.
+        const char* typeName;
+        std::vector<std::shared_ptr<InstanceSlot>> owners;
     };
 
+    // Every implementation registered for the interface T, in registration order.
+    // Entries are never modified once published, registering one more copies the lists.
+    template<class T>
+    class MultiBinding final : public MultiBindingBase
+    {
+    public:
+        MultiBinding() :
+                MultiBindingBase(TypeId::Name<T>())
+        {
+        }
+
+        std::vector<T*> instances;
+        std::vector<std::function<std::unique_ptr<T>()>> factories;
+        // OwnerToken values, parallel to instances and factories.
+        std::vector<std::uint32_t> instanceOwners;
+        std::vector<std::uint32_t> factoryOwners;
+    };
+
+
+    // Key of a tagged registration. The registered type and, for transients, the argument list are part of the
+    // key, so registrations of different types under one tag never collide.
+    struct TaggedKey
+    {
+        std::uint64_t typeId;
+        std::uint32_t tag;
+        std::uint64_t argumentsId;
+
+        bool operator==(const TaggedKey& other) const
+        {
+            return typeId == other.typeId && tag == other.tag && argumentsId == other.argumentsId;
+        }
+    };
+
+    struct TaggedKeyHash
+    {
+        std::size_t operator()(const TaggedKey& key) const
+        {
+            auto hash = (key.typeId ^ key.tag) * 0x9E3779B97F4A7C15ull;
+            hash ^= (hash >> 29) + key.argumentsId * 0xBF58476D1CE4E5B9ull;
+            return static_cast<std::size_t>(hash ^ (hash >> 32));
+        }
+    };
+
+    // Integral and enum tag keys index an array per type directly, so they have to be small and dense.
+    inline constexpr std::size_t maxTagKey = 1024;
+
+    template<class Key>
+    using IsTagKey = std::integral_constant<bool, std::is_integral<Key>::value || std::is_enum<Key>::value>;
+
+    template<class Entry>
+    struct KeyedEntries
+    {
+        std::vector<std::shared_ptr<Entry>> entries;
+    };
+
+
+    // Singletons resolved while a singleton factory runs on this thread are recorded as its dependencies.
+    class ConstructionScope
+    {
+    private:
+        ConstructionScope* parent;
+        std::vector<std::shared_ptr<const InstanceSlot>> dependencies;
+
+        static ConstructionScope*& Current()
+        {
+            thread_local ConstructionScope* current = nullptr;
+            return current;
+        }
+    public:
+        ConstructionScope() :
+                parent(Current())
+        {
+            Current() = this;
+        }
+
+        ConstructionScope(const ConstructionScope&) = delete;
+        ConstructionScope& operator=(const ConstructionScope&) = delete;
+
+        ~ConstructionScope()
+        {
+            Current() = parent;
+        }
+
+        static void Resolved(const InstanceSlot& slot)
+        {
+            auto* current = Current();
+            if (current == nullptr)
+                return;
+            if (auto owner = slot.weak_from_this().lock())
+                current->dependencies.push_back(std::move(owner));
+        }
+
+        std::vector<std::shared_ptr<const InstanceSlot>>& Dependencies()
+        {
+            return dependencies;
+        }
+    };
+
+
+    // Registry entries recently resolved on this thread, direct mapped and shared by every Injector. A line is only
+    // valid for the generation it was filled in, and an Injector takes a new generation from a process wide
+    // counter each time it publishes a change, so a hit needs no access to shared memory.
+    class ResolveCache
+    {
+    private:
+        struct Line
+        {
+            std::uint64_t generation;
+            std::uint64_t key;
+            std::uint32_t tag;
+            void* entry;
+        };
+
+        static constexpr std::size_t lineBits = 6;
+
+        static Line& LineOf(std::uint64_t key, std::uint32_t tag)
+        {
+            // Type ids are hashes and tag ids are dense, so distinct keys rarely share a line.
+            thread_local Line lines[std::size_t{1} << lineBits];
+            return lines[(key ^ tag * 0x9E3779B1u) & ((std::size_t{1} << lineBits) - 1)];
+        }
+
+        // Mixes the address of a module local object, which differs between the modules of a process and, with
+        // address space randomization, between runs. The top bit is set, so the counter never reaches 0, the
+        // generation of an Injector that never changed.
+        static std::uint64_t Seed()
+        {
+            static const int local = 0;
+            auto seed = static_cast<std::uint64_t>(reinterpret_cast<std::uintptr_t>(&local));
+            seed = (seed ^ (seed >> 30)) * 0xBF58476D1CE4E5B9ull;
+            seed = (seed ^ (seed >> 27)) * 0x94D049BB133111EBull;
+            return (seed ^ (seed >> 31)) | (std::uint64_t{1} << 63);
+        }
+    public:
+        static constexpr std::uint32_t untagged = ~std::uint32_t{0};
+        static constexpr std::uint32_t sharded = untagged - 1;
+
+        // Modules built with hidden visibility have their own counter and cache lines, and resolve on each other's
+        // Injectors. Every counter starts at a random point, so generations of different modules do not meet.
+        static std::uint64_t NextGeneration()
+        {
+            static std::atomic<std::uint64_t> generation{Seed()};
+            return generation.fetch_add(1, std::memory_order_relaxed) + 1;
+        }
+
+        static void* Find(std::uint64_t generation, std::uint64_t key, std::uint32_t tag)
+        {
+            const auto& line = LineOf(key, tag);
+            return line.generation == generation && line.key == key && line.tag == tag ? line.entry : nullptr;
+        }
+
+        static void Store(std::uint64_t generation, std::uint64_t key, std::uint32_t tag, void* entry)
+        {
+            LineOf(key, tag) = Line{generation, key, tag, entry};
+        }
+    };
+
+
+    // What a fast Shutdown does with a singleton. Leak is meant for singletons that only hold memory and handles
+    // the operating system reclaims at exit.
+    enum class Teardown
+    {
+        Destroy,
+        LeakOnFastShutdown
+    };
+
+    // Defined in Shutdown.h, together with Injector::Shutdown.
+    enum class ShutdownMode;
+    struct ShutdownReport;
+
+
+    // A singleton constructed outside the registration that added it, like an AsyncSingleton on its own thread.
+    class PendingSingleton
+    {
+    public:
+        explicit PendingSingleton(const char* typeName) :
+                typeName(typeName)
+        {
+        }
+
+        virtual ~PendingSingleton() = default;
+
+        // Waits for a construction that started. Null if it never started or the factory threw.
+        virtual std::shared_ptr<InstanceSlot> Finish() = 0;
+
+        // TypeId::Name of the singleton.
+        const char* typeName;
+    };
+
+
+    // The singletons an Injector constructed, in construction order, with the singletons each one resolved while
+    // it was constructed. Holds one reference to each, released dependents first.
+    class SingletonGraph
+    {
+    private:
+        struct Node
+        {
+            std::shared_ptr<InstanceSlot> slot;
+            const char* type;
+            Teardown teardown;
+            std::vector<std::uint32_t> dependencies;
+        };
+
+        static constexpr std::uint32_t discarded = ~std::uint32_t{0};
+
+        std::vector<Node> nodes;
+        PersistentMap<const InstanceSlot*, std::uint32_t> indices;
+        std::vector<std::shared_ptr<PendingSingleton>> pending;
+    public:
+        SingletonGraph() = default;
+        SingletonGraph(const SingletonGraph&) = delete;
+        SingletonGraph& operator=(const SingletonGraph&) = delete;
+        SingletonGraph(SingletonGraph&&) = default;
+        SingletonGraph& operator=(SingletonGraph&&) = default;
+
+        // Reverse construction order is a valid teardown order, dependencies are always constructed first.
+        ~SingletonGraph()
+        {
+            Settle();
+            while (!nodes.empty())
+                nodes.pop_back();
+        }
+
+        // singleton joins the graph once its construction finished, see Settle.
+        void Track(std::shared_ptr<PendingSingleton> singleton)
+        {
+            pending.push_back(std::move(singleton));
+        }
+
+        // Stops tracking the pending singleton that shares ownership with entry, its registration was removed.
+        void Untrack(const std::shared_ptr<const void>& entry)
+        {
+            pending.erase(std::remove_if(pending.begin(), pending.end(), [&](const auto& singleton)
+            { return !singleton.owner_before(entry) && !entry.owner_before(singleton); }), pending.end());
+        }
+
+        // Waits for the pending constructions that started and adds their singletons after the ones constructed
+        // so far. Whatever resolved them during construction keeps them alive through its own slot.
+        void Settle()
+        {
+            auto settled = std::move(pending);
+            pending.clear();
+            for (const auto& singleton : settled)
+            {
+                if (auto slot = singleton->Finish())
+                {
+                    const auto& dependencies = slot->Dependencies();
+                    Add(std::move(slot), singleton->typeName, Teardown::Destroy, dependencies);
+                }
+            }
+        }
+
+        // Dependencies constructed by another Injector are skipped, the slot itself keeps them alive.
+        template<class = void>
+        void Add(std::shared_ptr<InstanceSlot> slot, const char* type, Teardown teardown,
+                 const std::vector<std::shared_ptr<const InstanceSlot>>& dependencies)
+        {
+            Node node{std::move(slot), type, teardown, {}};
+            for (const auto& dependency : dependencies)
+            {
+                auto* index = indices.Find(dependency.get());
+                if (index != nullptr && *index != discarded)
+                    node.dependencies.push_back(*index);
+            }
+            indices.Set(node.slot.get(), static_cast<std::uint32_t>(nodes.size()));
+            nodes.push_back(std::move(node));
+        }
+
+        // Drops the last added singleton, used when its registration failed.
+        template<class = void>
+        void Discard(const InstanceSlot* slot)
+        {
+            if (nodes.empty() || nodes.back().slot.get() != slot)
+                return;
+            indices.Set(slot, discarded);
+            nodes.pop_back();
+        }
+
+        // Hands out the graph's reference to a replaced singleton. A singleton that a live singleton resolved during
+        // its construction stays in the graph and is released after its dependents.
+        template<class = void>
+        std::shared_ptr<InstanceSlot> Remove(const InstanceSlot* slot)
+        {
+            auto* index = indices.Find(slot);
+            if (index == nullptr || *index == discarded)
+                return nullptr;
+            for (const auto& node : nodes)
+            {
+                if (node.slot == nullptr)
+                    continue;
+                for (auto dependency : node.dependencies)
+                {
+                    if (dependency == *index)
+                        return nullptr;
+                }
+            }
+            auto position = *index;
+            indices.Set(slot, discarded);
+            return std::move(nodes[position].slot);
+        }
+
+        // Drops the records of removed singletons and renumbers the others.
+        template<class = void>
+        void Compact()
+        {
+            std::vector<std::uint32_t> positions(nodes.size(), discarded);
+            std::vector<Node> live;
+            for (std::size_t index = 0; index < nodes.size(); index++)
+            {
+                if (nodes[index].slot == nullptr)
+                    continue;
+                positions[index] = static_cast<std::uint32_t>(live.size());
+                live.push_back(std::move(nodes[index]));
+            }
+
+            indices = {};
+            for (std::uint32_t index = 0; index < live.size(); index++)
+            {
+                auto& dependencies = live[index].dependencies;
+                for (auto& dependency : dependencies)
+                    dependency = positions[dependency];
+                dependencies.erase(std::remove(dependencies.begin(), dependencies.end(), discarded), dependencies.end());
+                indices.Set(live[index].slot.get(), index);
+            }
+            nodes = std::move(live);
+        }
+
+        std::size_t Size() const
+        {
+            return nodes.size();
+        }
+
+        // Wave 0 are the singletons nothing depends on, each later wave only has dependents in earlier waves. The
+        // singletons of one wave are released in parallel on up to threads threads. A fast release leaks the
+        // singletons marked for it, unless another Injector still holds them.
+        ShutdownReport Release(std::size_t threads, ShutdownMode mode, TraceSink* tracer);
+    };
+
+
+    // Registration tables. They are persistent maps, so copying a Registry is O(1) and shares every entry.
+    struct Registry
+    {
+        PersistentMap<TaggedKey, std::shared_ptr<InstanceSlot>, TaggedKeyHash> tagSingletons;
+        PersistentMap<std::uint64_t, std::shared_ptr<InstanceSlot>> singletons;
+        PersistentMap<std::uint64_t, std::shared_ptr<ThreadLocalRegistration>> threadLocals;
+        PersistentMap<std::uint64_t, std::shared_ptr<AsyncSingleton>> asyncSingletons;
+        PersistentMap<std::uint64_t, std::shared_ptr<MultiBindingBase>> multiBindings;
+        PersistentMap<std::uint64_t, std::shared_ptr<RecycledRegistrationBase>> recycled;
+        PersistentMap<std::uint64_t, std::shared_ptr<ShardedBase>> sharded;
+        PersistentMap<std::uint64_t, std::shared_ptr<KeyedEntries<InstanceSlot>>> keyedSingletons;
+        PersistentMap<std::uint64_t, std::shared_ptr<KeyedEntries<FunctionWrapperBase>>> keyedTransients;
+
+        PersistentMap<TaggedKey, std::shared_ptr<FunctionWrapperBase>, TaggedKeyHash> transientTag;
+        PersistentMap<std::uint64_t, std::shared_ptr<FunctionWrapperBase>> transient;
+        PersistentMap<std::uint64_t, std::shared_ptr<FunctionWrapperBase>> values;
+
+        PersistentMap<std::uint32_t, std::shared_ptr<FunctionWrapperBase>> placementTransientTag;
+        PersistentMap<std::uint64_t, std::shared_ptr<FunctionWrapperBase>> placementTransient;
+
+        template<class = void>
+        Registry Compacted() const
+        {
+            return Registry{tagSingletons.Compacted(), singletons.Compacted(), threadLocals.Compacted(),
+                            asyncSingletons.Compacted(), multiBindings.Compacted(), recycled.Compacted(),
+                            sharded.Compacted(), keyedSingletons.Compacted(), keyedTransients.Compacted(), transientTag.Compacted(),
+                            transient.Compacted(), values.Compacted(), placementTransientTag.Compacted(),
+                            placementTransient.Compacted()};
+        }
+    };
+
+
+    // Defined in Manifest.h and FactoryRegistry.h, which also defines Injector::AdoptManifest.
+    class Manifest;
+    class FactoryRegistry;
+
+    class Injector
+    {
+    private:
+        using TagIds = PersistentMap<std::string, std::uint32_t, TagHash>;
+
+        // Interned tags, published like the view so interning does not disturb resolves on other threads. Children
+        // and forks start from a copy.
+        std::atomic<const TagIds*> tagIds{new TagIds()};
+        // Declared before the tables, so it releases the singletons after the tables dropped their references.
+        SingletonGraph graph;
+        // Registrations made on this Injector.
+        Registry registry;
+        // The parent's view when this child was created. Unregistering an override makes its entry visible again.
+        Registry inherited;
+        // Registrations visible to resolves, the parent's view with this Injector's registrations on top. Each
+        // change publishes a new snapshot, resolves read whichever one is current.
+        std::atomic<const Registry*> view{new Registry()};
+        // Identifies the current view in the resolve cache, 0 until the first change.
+        std::atomic<std::uint64_t> generation{0};
+        bool inherits = false;
+        TraceSink* tracer = nullptr;
+        // Created by EnableReplace. Resolves pin it and unpublished snapshots are retired to it instead of freed.
+        std::unique_ptr<EpochDomain> epoch;
+        // Set by EnableResolveCache.
+        bool cached = false;
+
+        // Singletons whose registration was removed, dropped together with the snapshot that still shows them.
+        using Released = std::vector<std::shared_ptr<InstanceSlot>>;
+
+        // Changes made inside Batch, published together when it ends.
+        struct Staged
+        {
+            Registry next;
+            Released released;
+        };
+
+        std::unique_ptr<Staged> staged;
+
+        struct RetiredView
+        {
+            std::unique_ptr<const Registry> view;
+            Released singletons;
+        };
+
+        // Unregister receives entry. Its key may hold another registration by now, which must stay.
+        using Unregistration = std::function<void(Injector&, const std::weak_ptr<const void>&, Registry&, Released&)>;
+
+        struct OwnedRegistration
+        {
+            std::uint32_t owner;
+            // The registered entry, empty when unregister finds the owner's part itself.
+            std::weak_ptr<const void> entry;
+            Unregistration unregister;
+        };
+
+        OwnerToken owner;
+        // Registrations made while an owner was set, with how to remove each one.
+        std::vector<OwnedRegistration> owned;
+
+        // Only valid while the epoch is pinned, or on the thread that changes the registrations.
+        const Registry& View() const
+        {
+            return *view.load(std::memory_order_seq_cst);
+        }
+
+        EpochGuard Guard() const
+        {
+            return EpochGuard(epoch.get());
+        }
+
+        // Waits until the resolves running on this Injector finished and frees the retired snapshots. Only pins on
+        // this Injector are waited for, one held by the calling thread is an error.
+        void Synchronize()
+        {
+            if (epoch == nullptr)
+                return;
+            if (EpochGuard::Held(epoch.get()))
+                ThrowError("Injector is pinned by the calling thread!");
+            while (!epoch->Collect())
+                YieldThread();
+        }
+
+        // The registrations the next change starts from, the staged ones inside Batch.
+        const Registry& Latest() const
+        {
+            return staged != nullptr ? staged->next : View();
+        }
+
+        // A replaced singleton goes with the snapshot that still shows it.
+        template<class = void>
+        void Publish(Registry next, Released released = {})
+        {
+            if (staged != nullptr)
+            {
+                staged->next = std::move(next);
+                staged->released.insert(staged->released.end(), std::make_move_iterator(released.begin()),
+                                        std::make_move_iterator(released.end()));
+                return;
+            }
+            std::unique_ptr<const Registry> previous(view.exchange(new Registry(std::move(next))));
+            generation.store(ResolveCache::NextGeneration());
+            if (epoch == nullptr)
+                return;
+            epoch->Retire(std::make_shared<const RetiredView>(RetiredView{std::move(previous), std::move(released)}));
+            epoch->Collect();
+        }
+
+        // Publishes the changes function makes as one snapshot, when it returns or throws.
+        template<class F>
+        void Batch(const F& function)
+        {
+            staged = std::make_unique<Staged>(Staged{View(), {}});
+            auto publish = [this]()
+            {
+                auto batch = std::move(staged);
+                Publish(std::move(batch->next), std::move(batch->released));
+            };
+            try
+            {
+                function();
+            }
+            catch (...)
+            {
+                publish();
+                throw;
+            }
+            publish();
+        }
+
+        // hash is TagHash of tag. Only a new tag is copied.
+        template<class = void>
+        TagId InternTag(std::string_view tag, std::size_t hash)
+        {
+            const auto& current = *tagIds.load();
+            if (auto* value = current.Find(tag, hash))
+                return TagId{*value};
+            auto value = static_cast<std::uint32_t>(current.Size());
+            auto next = std::make_unique<TagIds>(current);
+            next->Set(std::string(tag), value, hash);
+            std::unique_ptr<const TagIds> previous(tagIds.exchange(next.release()));
+            if (epoch != nullptr)
+                epoch->Retire(std::shared_ptr<const TagIds>(std::move(previous)));
+            return TagId{value};
+        }
+
+        template<class = void>
+        bool FindTagId(const std::string& tag, TagId& id) const
+        {
+            auto pin = Guard();
+            auto* value = tagIds.load()->Find(tag);
+            if (value == nullptr)
+                return false;
+            id = TagId{*value};
+            return true;
+        }
+
+        // Finds key in the view, through the thread's resolve cache when it is enabled.
+        template<class Key, class Entry, class Hash>
+        Entry* Lookup(PersistentMap<Key, std::shared_ptr<Entry>, Hash> Registry::* table, const Key& key,
+                      std::uint64_t cacheKey, std::uint32_t cacheTag) const
+        {
+            if (!cached)
+            {
+                auto* entry = (View().*table).Find(key);
+                return entry == nullptr ? nullptr : entry->get();
+            }
+
+            // Loaded before the view, so a line never claims a newer generation than its entry.
+            auto current = generation.load();
+            if (auto* entry = ResolveCache::Find(current, cacheKey, cacheTag))
+                return static_cast<Entry*>(entry);
+            auto* entry = (View().*table).Find(key);
+            if (entry == nullptr)
+                return nullptr;
+            ResolveCache::Store(current, cacheKey, cacheTag, entry->get());
+            return entry->get();
+        }
+
+        // Non template resolve core. The typed Resolve functions only add the final cast on top, so lookups and
+        // their error paths are compiled once instead of once per resolved type. Untagged singletons and transients
+        // can be replaced, their callers keep the epoch pinned while they use the result.
+        InstanceSlot& SingletonSlot(std::uint64_t typeId) const
+        {
+            auto* slot = Lookup(&Registry::singletons, typeId, typeId, ResolveCache::untagged);
+            if (slot == nullptr)
+                ThrowError("Singleton not registered!");
+            ConstructionScope::Resolved(*slot);
+            return *slot;
+        }
+
+        InstanceSlot& SingletonSlot(const TaggedKey& key) const
+        {
+            auto pin = Guard();
+            auto* slot = Lookup(&Registry::tagSingletons, key, key.typeId, key.tag);
+            if (slot == nullptr)
+                ThrowError("Singleton not registered!");
+            ConstructionScope::Resolved(*slot);
+            return *slot;
+        }
+
+        template<class = void>
+        InstanceSlot& SingletonSlot(const std::string& tag, std::uint64_t typeId) const
+        {
+            TagId id{};
+            if (!FindTagId(tag, id))
+                ThrowError("Singleton not registered!");
+            return SingletonSlot(TaggedKey{typeId, id.value, 0});
+        }
+
+        FunctionWrapperBase& TransientWrapper(std::uint64_t signature) const
+        {
+            auto* functionWrapper = Lookup(&Registry::transient, signature, signature, ResolveCache::untagged);
+            if (functionWrapper == nullptr)
+                ThrowError("Type not registered!");
+            return *functionWrapper;
+        }
+
+        FunctionWrapperBase& TransientWrapper(const TaggedKey& key) const
+        {
+            auto pin = Guard();
+            auto* functionWrapper = View().transientTag.Find(key);
+            if (functionWrapper == nullptr)
+                ThrowError("Type not registered!");
+            return **functionWrapper;
+        }
+
+        template<class = void>
+        FunctionWrapperBase& TransientWrapper(const std::string& tag, std::uint64_t typeId, std::uint64_t argumentsId) const
+        {
+            TagId id{};
+            if (!FindTagId(tag, id))
+                ThrowError("Type not registered!");
+            return TransientWrapper(TaggedKey{typeId, id.value, argumentsId});
+        }
+
+        // Registrations are found by the id of T, their type name confirms the match before the cast.
+        template<class T, class Registration, class Base>
+        static Registration* Checked(Base* registration)
+        {
+            if (registration != nullptr && !TypeId::Is<T>(registration->typeName))
+                ThrowError("Type mismatch!");
+            return static_cast<Registration*>(registration);
+        }
+
+        template<class ... Args>
+        static FunctionWrapper<Args...>& Factory(FunctionWrapperBase& functionWrapper)
+        {
+            auto* result = functionWrapper.template As<Args...>();
+            if (result == nullptr)
+                ThrowError("Factory function mismatch!");
+            return *result;
+        }
+
+        template<class T>
+        static T* SingletonOf(const InstanceSlot& slot)
+        {
+            auto* result = slot.Get<T>();
+            if (result == nullptr)
+                ThrowError("Singleton type mismatch!");
+            return result;
+        }
+
+        template<class T>
+        TraceScope Trace(const char* name) const
+        {
+            return TraceScope(tracer, name, tracer == nullptr ? nullptr : TypeId::Name<T>());
+        }
+
+        // create returns the InstanceSlot of a new T. The slot is added to the graph with the singletons create
+        // resolved.
+        template<class T, class F>
+        std::shared_ptr<InstanceSlot> Construct(const F& create, Teardown teardown = Teardown::Destroy)
+        {
+            ConstructionScope construction;
+            std::shared_ptr<InstanceSlot> slot;
+            {
+                auto scope = Trace<T>("Factory");
+                slot = std::make_shared<InstanceSlot>(create());
+            }
+            graph.Add(slot, TypeId::Name<T>(), teardown, construction.Dependencies());
+            slot->Depend(std::move(construction.Dependencies()));
+            return slot;
+        }
+
+        template<class T, class F>
+        std::shared_ptr<InstanceSlot> CreateSingleton(const F& factoryFunction, Teardown teardown = Teardown::Destroy)
+        {
+            return Construct<T>([&]()
+            { return InstanceSlot::Adopt<T>(factoryFunction()); }, teardown);
+        }
+
+        template<class T, class F>
+        std::shared_ptr<InstanceSlot> CreateSharedSingleton(const F& factoryFunction, Teardown teardown = Teardown::Destroy)
+        {
+            return Construct<T>([&]()
+            { return InstanceSlot::AdoptShared<T>(new SharedBlock<decltype(factoryFunction())>(factoryFunction)); }, teardown);
+        }
+
+        template<class Entry>
+        void Discard(const std::shared_ptr<Entry>& entry)
+        {
+            if constexpr (std::is_same<Entry, InstanceSlot>::value)
+                graph.Discard(entry.get());
+        }
+
+        template<class Key, class Entry, class Hash>
+        void Insert(PersistentMap<Key, std::shared_ptr<Entry>, Hash> Registry::* table, const Key& key,
+                    std::shared_ptr<Entry> entry, const char* error)
+        {
+            TraceScope scope(tracer, "Register", nullptr);
+            if (!(registry.*table).Insert(key, entry))
+            {
+                Discard(entry);
+                ThrowError(error);
+            }
+            Own(entry, [table, key](Injector& injector, const std::weak_ptr<const void>& registered, Registry& next,
+                                    Released& released)
+            {
+                auto* current = (injector.registry.*table).Find(key);
+                if (current != nullptr && IsEntry(*current, registered))
+                    injector.Erase(table, key, next, released);
+            });
+            auto next = Latest();
+            if (inherits)
+                (next.*table).Set(key, std::move(entry));
+            else
+                next.*table = registry.*table;
+            Publish(std::move(next));
+        }
+
+        // Overwrites a visible registration. A previous singleton is dropped once no resolve can still read it.
+        template<class Entry>
+        void Swap(PersistentMap<std::uint64_t, std::shared_ptr<Entry>> Registry::* table, std::uint64_t key,
+                  std::shared_ptr<Entry> entry)
+        {
+            TraceScope scope(tracer, "Replace", nullptr);
+            Released released;
+            if (auto* previous = (View().*table).Find(key))
+            {
+                Release(*previous, released);
+                // The replacement stays with the owner of the registration it replaces.
+                for (auto& registration : owned)
+                {
+                    if (IsEntry(*previous, registration.entry))
+                        registration.entry = entry;
+                }
+            }
+            (registry.*table).Set(key, entry);
+            auto next = Latest();
+            if (inherits)
+                (next.*table).Set(key, std::move(entry));
+            else
+                next.*table = registry.*table;
+            Publish(std::move(next), std::move(released));
+        }
+
+        // Takes the graph's references to the singletons of a removed entry, they are dropped with the snapshot.
+        template<class Entry>
+        void Release(const std::shared_ptr<Entry>& entry, Released& released)
+        {
+            if constexpr (std::is_same<Entry, InstanceSlot>::value)
+            {
+                if (auto slot = graph.Remove(entry.get()))
+                    released.push_back(std::move(slot));
+            }
+            else if constexpr (std::is_same<Entry, MultiBindingBase>::value)
+            {
+                for (const auto& slot : entry->owners)
+                    Release(slot, released);
+            }
+            else if constexpr (std::is_same<Entry, AsyncSingleton>::value)
+                graph.Untrack(entry);
+        }
+
+        // Removes a registration made on this Injector from the tables and from next.
+        template<class Key, class Entry, class Hash>
+        void Erase(PersistentMap<Key, std::shared_ptr<Entry>, Hash> Registry::* table, const Key& key, Registry& next,
+                   Released& released)
+        {
+            auto* entry = (registry.*table).Find(key);
+            if (entry == nullptr)
+                return;
+            Release(*entry, released);
+            (registry.*table).Erase(key);
+            if (!inherits)
+                next.*table = registry.*table;
+            else if (auto* previous = (inherited.*table).Find(key))
+                (next.*table).Set(key, *previous);
+            else
+                (next.*table).Erase(key);
+        }
+
+        template<class Key, class Entry, class Hash, class Predicate>
+        void EraseIf(PersistentMap<Key, std::shared_ptr<Entry>, Hash> Registry::* table, const Predicate& predicate,
+                     Registry& next, Released& released)
+        {
+            std::vector<Key> keys;
+            (registry.*table).ForEach([&](const Key& key, const std::shared_ptr<Entry>& entry)
+            {
+                if (predicate(key, *entry))
+                    keys.push_back(key);
+            });
+            for (const auto& key : keys)
+                Erase(table, key, next, released);
+        }
+
+        template<class Entry>
+        void EraseKeyed(PersistentMap<std::uint64_t, std::shared_ptr<KeyedEntries<Entry>>> Registry::* table,
+                        std::uint64_t typeId, std::size_t index, Registry& next, Released& released)
+        {
+            auto* own = (registry.*table).Find(typeId);
+            if (own == nullptr || index >= (*own)->entries.size() || (*own)->entries[index] == nullptr)
+                return;
+            Release((*own)->entries[index], released);
+            auto keyed = WithKey(registry.*table, typeId, index, std::shared_ptr<Entry>());
+            while (!keyed->entries.empty() && keyed->entries.back() == nullptr)
+                keyed->entries.pop_back();
+            if (keyed->entries.empty())
+                (registry.*table).Erase(typeId);
+            else
+                (registry.*table).Set(typeId, std::move(keyed));
+
+            if (!inherits)
+            {
+                next.*table = registry.*table;
+                return;
+            }
+            std::shared_ptr<Entry> previous;
+            auto* parent = (inherited.*table).Find(typeId);
+            if (parent != nullptr && index < (*parent)->entries.size())
+                previous = (*parent)->entries[index];
+            (next.*table).Set(typeId, WithKey(next.*table, typeId, index, previous));
+        }
+
+        // Removes the implementations of T that owner registered.
+        template<class T>
+        void EraseMulti(std::uint32_t owner, Registry& next, Released& released)
+        {
+            auto* own = registry.multiBindings.Find(TypeId::Of<T>());
+            if (own == nullptr)
+                return;
+            const auto& current = *Checked<T, const MultiBinding<T>>(own->get());
+            auto binding = std::make_shared<MultiBinding<T>>();
+            for (std::size_t index = 0; index < current.instances.size(); index++)
+            {
+                if (current.instanceOwners[index] == owner)
+                {
+                    Release(current.owners[index], released);
+                    continue;
+                }
+                binding->instances.push_back(current.instances[index]);
+                binding->owners.push_back(current.owners[index]);
+                binding->instanceOwners.push_back(current.instanceOwners[index]);
+            }
+            for (std::size_t index = 0; index < current.factories.size(); index++)
+            {
+                if (current.factoryOwners[index] == owner)
+                    continue;
+                binding->factories.push_back(current.factories[index]);
+                binding->factoryOwners.push_back(current.factoryOwners[index]);
+            }
+            registry.multiBindings.Set(TypeId::Of<T>(), binding);
+            if (inherits)
+                next.multiBindings.Set(TypeId::Of<T>(), std::move(binding));
+            else
+                next.multiBindings = registry.multiBindings;
+        }
+
+        // Records how to remove a registration just made, if an owner is set.
+        template<class = void>
+        void Own(std::weak_ptr<const void> entry, Unregistration unregister)
+        {
+            if (owner.value != 0)
+                owned.push_back(OwnedRegistration{owner.value, std::move(entry), std::move(unregister)});
+        }
+
+        // Compares ownership, so an entry allocated where a removed one was is still a different entry.
+        template<class Entry>
+        static bool IsEntry(const std::shared_ptr<Entry>& entry, const std::weak_ptr<const void>& registered)
+        {
+            return !entry.owner_before(registered) && !registered.owner_before(entry);
+        }
+
+        template<class F>
+        void Unregister(const F& erase)
+        {
+            TraceScope scope(tracer, "Unregister", nullptr);
+            auto next = Latest();
+            Released released;
+            erase(next, released);
+            Publish(std::move(next), std::move(released));
+        }
+
+        // Untagged registrations of any kind, compiled once for every type and only if Unregister is used.
+        template<class = void>
+        void UnregisterType(std::uint64_t typeId)
+        {
+            Unregister([&](Registry& next, Released& released)
+            {
+                auto registeredType = [typeId](std::uint64_t, const FunctionWrapperBase& functionWrapper)
+                { return functionWrapper.typeId == typeId; };
+                Erase(&Registry::singletons, typeId, next, released);
+                Erase(&Registry::threadLocals, typeId, next, released);
+                Erase(&Registry::asyncSingletons, typeId, next, released);
+                Erase(&Registry::multiBindings, typeId, next, released);
+                Erase(&Registry::recycled, typeId, next, released);
+                Erase(&Registry::sharded, typeId, next, released);
+                EraseIf(&Registry::transient, registeredType, next, released);
+                EraseIf(&Registry::values, registeredType, next, released);
+                EraseIf(&Registry::placementTransient, registeredType, next, released);
+            });
+        }
+
+        template<class T>
+        static TaggedKey SingletonKey(TagId tag)
+        {
+            return TaggedKey{TypeId::Of<T>(), tag.value, 0};
+        }
+
+        template<class T, class ... Args>
+        static TaggedKey TransientKey(TagId tag)
+        {
+            return TaggedKey{TypeId::Of<T>(), tag.value, TypeId::Of<FunctionWrapper<Args...>>()};
+        }
+
+        template<class Entry>
+        void Insert(PersistentMap<std::uint32_t, std::shared_ptr<Entry>> Registry::* table, TagId tag,
+                    std::shared_ptr<Entry> entry, const char* error)
+        {
+            Insert(table, tag.value, std::move(entry), error);
+        }
+
+        template<class Key, class Entry, class Hash>
+        Entry* Find(PersistentMap<Key, std::shared_ptr<Entry>, Hash> Registry::* table, const Key& key) const
+        {
+            auto pin = Guard();
+            auto* entry = (View().*table).Find(key);
+            return entry == nullptr ? nullptr : entry->get();
+        }
+
+        template<class Entry>
+        Entry* Find(PersistentMap<std::uint32_t, std::shared_ptr<Entry>> Registry::* table, TagId tag) const
+        {
+            return Find(table, tag.value);
+        }
+
+        template<class Key>
+        static std::size_t KeyIndex(Key key)
+        {
+            using Underlying = typename std::conditional_t<std::is_enum<Key>::value, std::underlying_type<Key>,
+                    std::enable_if<true, Key>>::type;
+            auto value = static_cast<Underlying>(key);
+            if constexpr (std::is_signed<Underlying>::value)
+            {
+                if (value < 0)
+                    ThrowError("Tag key out of range!");
+            }
+            if (static_cast<std::size_t>(value) >= maxTagKey)
+                ThrowError("Tag key out of range!");
+            return static_cast<std::size_t>(value);
+        }
+
+        template<class Entry>
+        static std::shared_ptr<KeyedEntries<Entry>> WithKey(const PersistentMap<std::uint64_t, std::shared_ptr<KeyedEntries<Entry>>>& table,
+                                                            std::uint64_t typeId, std::size_t index, const std::shared_ptr<Entry>& entry)
+        {
+            auto keyed = std::make_shared<KeyedEntries<Entry>>();
+            if (auto* existing = table.Find(typeId))
+                *keyed = **existing;
+            if (index >= keyed->entries.size())
+                keyed->entries.resize(index + 1);
+            keyed->entries[index] = entry;
+            return keyed;
+        }
+
+        // Keyed entries of a type are stored together, so the parent's keys are merged into the view.
+        template<class Entry>
+        void InsertKeyed(PersistentMap<std::uint64_t, std::shared_ptr<KeyedEntries<Entry>>> Registry::* table,
+                         std::uint64_t typeId, std::size_t index, const std::shared_ptr<Entry>& entry, const char* error)
+        {
+            auto* own = (registry.*table).Find(typeId);
+            if (own != nullptr && index < (*own)->entries.size() && (*own)->entries[index] != nullptr)
+            {
+                Discard(entry);
+                ThrowError(error);
+            }
+            (registry.*table).Set(typeId, WithKey(registry.*table, typeId, index, entry));
+            auto next = Latest();
+            if (inherits)
+                (next.*table).Set(typeId, WithKey(next.*table, typeId, index, entry));
+            else
+                next.*table = registry.*table;
+            Publish(std::move(next));
+            Own(entry, [table, typeId, index](Injector& injector, const std::weak_ptr<const void>& registered,
+                                              Registry& next, Released& released)
+            {
+                auto* current = (injector.registry.*table).Find(typeId);
+                if (current != nullptr && index < (*current)->entries.size() &&
+                    IsEntry((*current)->entries[index], registered))
+                    injector.EraseKeyed(table, typeId, index, next, released);
+            });
+        }
+
+        template<class Entry>
+        Entry* FindKeyed(PersistentMap<std::uint64_t, std::shared_ptr<KeyedEntries<Entry>>> Registry::* table,
+                         std::uint64_t typeId, std::size_t index) const
+        {
+            auto* keyed = Find(table, typeId);
+            if (keyed == nullptr || index >= keyed->entries.size())
+                return nullptr;
+            return keyed->entries[index].get();
+        }
+
+        // Adds to the visible multi binding of T without touching the entry other Injectors may share.
+        template<class T, class F>
+        void AppendMulti(const F& append)
+        {
+            auto binding = std::make_shared<MultiBinding<T>>();
+            if (auto* existing = Find(&Registry::multiBindings, TypeId::Of<T>()))
+                *binding = *Checked<T, const MultiBinding<T>>(existing);
+            append(*binding);
+            registry.multiBindings.Set(TypeId::Of<T>(), binding);
+            auto next = Latest();
+            if (inherits)
+                next.multiBindings.Set(TypeId::Of<T>(), std::move(binding));
+            else
+                next.multiBindings = registry.multiBindings;
+            Publish(std::move(next));
+            Own({}, [token = owner.value](Injector& injector, const std::weak_ptr<const void>&, Registry& next,
+                                          Released& released)
+            { injector.EraseMulti<T>(token, next, released); });
+        }
+
+        template<class T>
+        const MultiBinding<T>* FindMulti() const
+        {
+            return Checked<T, const MultiBinding<T>>(Find(&Registry::multiBindings, TypeId::Of<T>()));
+        }
+
+        template<typename T, typename F, typename R, typename ... Args>
+        static std::shared_ptr<FunctionWrapperBase> CreateFunctionWrapper(const F& factoryLambda, std::function<R*(Args...)>*)
+        {
+            return std::shared_ptr<FunctionWrapperBase>(FunctionWrapper<Args...>::template Create<T, R>(factoryLambda));
+        }
+
+        template<typename T, typename F>
+        static std::shared_ptr<FunctionWrapperBase> CreateFunctionWrapper(const F& factoryLambda)
+        {
+            using FunctionType = decltype(std::function{factoryLambda});
+            return CreateFunctionWrapper<T>(factoryLambda, static_cast<FunctionType*>(nullptr));
+        }
+
+        template<typename T, typename F, typename R, typename ... Args>
+        static std::shared_ptr<FunctionWrapperBase> CreatePlacementWrapper(const F& factoryLambda, std::function<R*(void*, Args...)>*)
+        {
+            return std::shared_ptr<FunctionWrapperBase>(PlacementFunctionWrapper<Args...>::template Create<T, R>(factoryLambda));
+        }
+
+        template<typename ... Args>
+        static PlacementFunctionWrapper<Args...>* AsPlacementWrapper(FunctionWrapperBase* functionWrapper)
+        {
+            auto* placementWrapper = functionWrapper->template To<PlacementFunctionWrapper<Args...>>();
+            if (placementWrapper == nullptr)
+                ThrowError("Factory function mismatch!");
+            return placementWrapper;
+        }
+
+        template<typename T, typename ... Args>
+        PlacementFunctionWrapper<Args...>* FindPlacementWrapper()
+        {
+            auto* functionWrapper = Find(&Registry::placementTransient, PlacementFunctionWrapper<Args...>::template GetTypeSignature<T>());
+            if (functionWrapper == nullptr)
+                ThrowError("Type not registered!");
+            return AsPlacementWrapper<Args...>(functionWrapper);
+        }
+
+        template<typename ... Args>
+        PlacementFunctionWrapper<Args...>* FindPlacementWrapper(TagId tag)
+        {
+            auto* functionWrapper = Find(&Registry::placementTransientTag, tag);
+            if (functionWrapper == nullptr)
+                ThrowError("Type not registered!");
+            return AsPlacementWrapper<Args...>(functionWrapper);
+        }
 
-    template<class ... Args>
-    class FunctionWrapper : public FunctionWrapperBase
-    {
-    private:
-        template<typename... Tuples>
-        struct tuple_type_cat final
+        template<typename ... Args>
+        PlacementFunctionWrapper<Args...>* FindPlacementWrapper(const std::string& tag)
         {
-            using type = typename std::function< decltype( std::tuple_cat<Tuples...> ) >::result_type;
-        };
+            TagId id{};
+            if (!FindTagId(tag, id))
+                ThrowError("Type not registered!");
+            return FindPlacementWrapper<Args...>(id);
+        }
+
+        template<typename T, typename R, typename ... Args>
+        void RegisterValue(const std::function<R(Args...)>& factoryFunc)
+        {
+            static_assert(std::is_same<R, T>::value, "Value factory must return T");
+            auto functionWrapper = std::make_shared<ValueFunctionWrapper<T, Args...>>(factoryFunc);
+            Insert(&Registry::values, functionWrapper->argumentsId, std::shared_ptr<FunctionWrapperBase>(functionWrapper),
+                   "Type already registered!");
+        }
     public:
-        ~FunctionWrapper() override = default;
-        template<class T>
-        static std::type_index GetTypeSignature()
+        Injector() = default;
+        Injector(const Injector&) = delete;
+        Injector& operator=(const Injector&) = delete;
+
+        Injector(Injector&& other) noexcept :
+                tagIds(other.tagIds.exchange(nullptr)), graph(std::move(other.graph)), registry(std::move(other.registry)),
+                inherited(std::move(other.inherited)), view(other.view.exchange(nullptr)),
+                generation(other.generation.load()), inherits(other.inherits), tracer(other.tracer),
+                epoch(std::move(other.epoch)), cached(other.cached), owner(other.owner), owned(std::move(other.owned))
         {
-            return std::type_index(typeid(tuple_type_cat<std::tuple<T, Args...>>));
         }
 
-        explicit FunctionWrapper(const std::function<Injectable*(Args...)>& factoryFunc) :
-                factoryFunc(factoryFunc)
+        Injector& operator=(Injector&& other) noexcept
+        {
+            if (this != &other)
+            {
+                // Releases the current registrations and singletons in destructor order when it goes out of scope.
+                Injector previous(std::move(*this));
+                tagIds.store(other.tagIds.exchange(nullptr));
+                graph = std::move(other.graph);
+                registry = std::move(other.registry);
+                inherited = std::move(other.inherited);
+                view.store(other.view.exchange(nullptr));
+                generation.store(other.generation.load());
+                inherits = other.inherits;
+                tracer = other.tracer;
+                epoch = std::move(other.epoch);
+                cached = other.cached;
+                owner = other.owner;
+                owned = std::move(other.owned);
+            }
+            return *this;
+        }
+
+        ~Injector()
+        {
+            // A running async construction may still resolve from the tables.
+            graph.Settle();
+            // Waiting for a pin of the destroying thread would never end, the guard still has to leave the domain.
+            if (epoch != nullptr && EpochGuard::Held(epoch.get()))
+                KeepUntilThreadExit(std::move(epoch));
+            else
+                Synchronize();
+            delete view.load();
+            delete tagIds.load();
+        }
+
+        static Injector& GetInstance()
+        {
+            static Injector instance;
+            return instance;
+        }
+
+        // The child sees every registration this Injector has now, plus its own registrations, which override
+        // the inherited ones. Creating a child is O(1) and each override only copies one trie path.
+        template<class = void>
+        Injector CreateChild() const
+        {
+            Injector child;
+            delete child.tagIds.exchange(new TagIds(*tagIds.load()));
+            child.inherited = View();
+            child.Publish(View());
+            child.inherits = true;
+            child.tracer = tracer;
+            if (epoch != nullptr)
+                child.EnableReplace();
+            child.cached = cached;
+            return child;
+        }
+
+        // Copies this Injector in O(1). The fork shares every registration made so far, including singleton
+        // instances, and later registrations on either side only affect that side.
+        template<class = void>
+        Injector Fork() const
+        {
+            Injector fork;
+            delete fork.tagIds.exchange(new TagIds(*tagIds.load()));
+            fork.registry = registry;
+            fork.inherited = inherited;
+            fork.Publish(View());
+            fork.inherits = inherits;
+            fork.tracer = tracer;
+            if (epoch != nullptr)
+                fork.EnableReplace();
+            fork.cached = cached;
+            return fork;
+        }
+
+        static OwnerToken CreateOwner()
         {
+            static std::atomic<std::uint32_t> counter{1};
+            return OwnerToken{counter.fetch_add(1, std::memory_order_relaxed)};
+        }
 
+        // Registrations made from now on belong to owner, until the next SetOwner. OwnerToken{} stops recording.
+        // Ownership is kept per Injector, forks and children do not inherit it.
+        void SetOwner(OwnerToken owner)
+        {
+            this->owner = owner;
         }
+
+        // Removes the untagged registrations of T made on this Injector, singletons, transients of every
+        // signature, values, thread locals, async, recycled and multi bindings. A child sees the parent's
+        // registration of T again. A removed singleton is destroyed unless another Injector or SharedHandle still
+        // holds it, or a live singleton resolved it during construction. Must not run while other threads resolve.
         template<class T>
-        std::type_index GenerateTypeSignature()
+        [[maybe_unused]] void Unregister()
         {
-            typeSignature = GetTypeSignature<T>();
-            return typeSignature;
+            UnregisterType(TypeId::Of<T>());
         }
-        std::function<Injectable*(Args...)> factoryFunc;
-        std::type_index typeSignature = typeid(FunctionWrapper);
-    };
 
+        // Removes every singleton and transient registered under tag on this Injector.
+        template<class = void>
+        void UnregisterTag(TagId tag)
+        {
+            Unregister([&](Registry& next, Released& released)
+            {
+                auto tagged = [tag](const TaggedKey& key, const auto&)
+                { return key.tag == tag.value; };
+                EraseIf(&Registry::tagSingletons, tagged, next, released);
+                EraseIf(&Registry::transientTag, tagged, next, released);
+                Erase(&Registry::placementTransientTag, tag.value, next, released);
+            });
+        }
 
-    class Injector
-    {
-    private:
-        static Injector* const instance;
-        std::unordered_map<std::string, std::unique_ptr<Injectable>> tagSingletons;
-        std::unordered_map<std::type_index, std::unique_ptr<Injectable>> singletons;
+        template<class = void>
+        void UnregisterTag(const std::string& tag)
+        {
+            TagId id{};
+            if (FindTagId(tag, id))
+                UnregisterTag(id);
+        }
 
-        std::unordered_map<std::string, std::unique_ptr<FunctionWrapperBase>> transientTag;
-        std::unordered_map<std::type_index, std::unique_ptr<FunctionWrapperBase>> transient;
-    public:
-        static Injector& GetInstance()
+        template<typename T, typename Key, std::enable_if_t<IsTagKey<Key>::value, int> = 0>
+        [[maybe_unused]] void UnregisterTag(Key key)
+        {
+            auto index = KeyIndex(key);
+            Unregister([&](Registry& next, Released& released)
+            {
+                EraseKeyed(&Registry::keyedSingletons, TypeId::Of<T>(), index, next, released);
+                EraseKeyed(&Registry::keyedTransients, TypeId::Of<T>(), index, next, released);
+            });
+        }
+
+        // Removes every registration made on this Injector while owner was set.
+        template<class = void>
+        void UnregisterOwner(OwnerToken owner)
+        {
+            Unregister([&](Registry& next, Released& released)
+            {
+                for (const auto& registration : owned)
+                {
+                    if (registration.owner == owner.value)
+                        registration.unregister(*this, registration.entry, next, released);
+                }
+            });
+            owned.erase(std::remove_if(owned.begin(), owned.end(), [&](const OwnedRegistration& registration)
+            { return registration.owner == owner.value; }), owned.end());
+        }
+
+        // Rebuilds the tables from newly allocated nodes and drops the graph records of removed singletons, so
+        // resolves stay local after many registrations were removed. The tables stop sharing nodes with forks and
+        // children. Must not run while other threads resolve.
+        template<class = void>
+        void Compact()
+        {
+            registry = registry.Compacted();
+            inherited = inherited.Compacted();
+            Publish(inherits ? View().Compacted() : registry);
+            graph.Compact();
+        }
+
+        // Records registrations, singleton factories and transient resolves into tracer, usually a Tracer from
+        // Tracer.h, until it is reset to nullptr.
+        // Children and forks created afterwards use the same tracer, which has to outlive them.
+        void SetTracer(TraceSink* tracer)
+        {
+            this->tracer = tracer;
+        }
+
+        // Drops every registration, then releases the singletons this Injector constructed, each one only after
+        // the singletons that resolved it during their construction. Singletons of one wave do not depend on each
+        // other and are released in parallel on up to threads threads, 0 uses every hardware thread. A singleton
+        // still held by a fork or a SharedHandle is destroyed when that last reference goes away. Without a
+        // Shutdown the destructor releases them on one thread in reverse construction order. Needs Shutdown.h.
+        ShutdownReport Shutdown(std::size_t threads = 0);
+
+        // A fast shutdown skips the destructors of singletons registered with Teardown::LeakOnFastShutdown and
+        // leaves their memory to the operating system. The others are destroyed as in an orderly shutdown.
+        ShutdownReport Shutdown(ShutdownMode mode, std::size_t threads = 0);
+
+        // From now on Replace and ReplaceSingleton may run while other threads resolve, at the cost of pinning the
+        // epoch on every resolve. Call it before those threads start resolving. Children and forks created
+        // afterwards inherit it.
+        void EnableReplace()
+        {
+            if (epoch == nullptr)
+                epoch = std::make_unique<EpochDomain>();
+        }
+
+        // Each thread remembers the registry entries its last resolves of singletons, tagged singletons and
+        // transients found, in a small direct mapped table. Repeated resolves of the same few types then skip the
+        // shared tables until this Injector's registrations change. Children and forks created afterwards
+        // inherit it.
+        void EnableResolveCache()
         {
-            return *instance;
+            cached = true;
         }
 
+        // A singleton resolved on this thread stays alive across a ReplaceSingleton until the returned guard is
+        // destroyed. Without a guard the previous instance is destroyed once the resolves that were running when
+        // it was replaced have returned, unless a singleton that resolved it during construction is still alive.
+        EpochGuard Pin() const
+        {
+            return Guard();
+        }
+
+        // Publishes a new factory for the transient of T with the same arguments. Resolves that already found the
+        // previous factory still call it.
+        template<typename T, typename F>
+        [[maybe_unused]] void Replace(const F& factoryLambda)
+        {
+            auto functionWrapper = CreateFunctionWrapper<T>(factoryLambda);
+            auto signature = functionWrapper->signatureId;
+            if (View().transient.Find(signature) == nullptr)
+                ThrowError("Type not registered!");
+            Swap(&Registry::transient, signature, std::move(functionWrapper));
+        }
+
+        // Constructs the new instance, then publishes it. Resolves see either the previous or the new instance.
         template<typename T>
-        [[maybe_unused]] void RegisterSingletonTag(const std::string& tag)
+        [[maybe_unused]] void ReplaceSingleton(Teardown teardown = Teardown::Destroy)
+        {
+            ReplaceSingleton<T>([]()
+            { return new T(); }, teardown);
+        }
+
+        // The factory returns a std::unique_ptr or a raw pointer to T, a child of T or an Injectable. It may
+        // resolve the previous instance of T, which then stays alive until the new one is released.
+        template<typename T, typename F>
+        [[maybe_unused]] void ReplaceSingleton(const F& factoryFunction, Teardown teardown = Teardown::Destroy)
+        {
+            if (View().singletons.Find(TypeId::Of<T>()) == nullptr)
+                ThrowError("Singleton not registered!");
+            Swap(&Registry::singletons, TypeId::Of<T>(), CreateSingleton<T>(factoryFunction, teardown));
+        }
+
+        // Registers every binding of the manifest under its tag, with the factory of the same id in factories.
+        // Needs FactoryRegistry.h.
+        // The manifest is read in place, its tags are interned with the hashes it stores and only new tags are
+        // copied. Resolves see the bindings once all of them are registered, or the ones registered before a
+        // factory threw.
+        void AdoptManifest(const Manifest& manifest, const FactoryRegistry& factories);
+
+        // Interns the tag on first use. Resolving through the returned id skips hashing the tag string.
+        // Children and forks created afterwards keep the id.
+        template<class = void>
+        TagId GetTagId(const std::string& tag)
         {
-            static_assert(std::is_base_of<Injectable, T>::value, "T must be a child of Injectable");
-            std::unique_ptr<T> singleton = std::unique_ptr<T>(new T());
-            auto result = tagSingletons.try_emplace(tag, std::move(singleton));
-            if (!result.second)
-                throw std::runtime_error("Singleton already registered!");
+            return InternTag(tag, TagHash{}(tag));
         }
 
+        // teardown decides whether a fast Shutdown may skip the destructor, see ShutdownMode::Fast.
         template<typename T>
-        [[maybe_unused]] void RegisterSingleton()
+        [[maybe_unused]] void RegisterSingletonTag(TagId tag, Teardown teardown = Teardown::Destroy)
         {
-            static_assert(std::is_base_of<Injectable, T>::value, "T must be a child of Injectable");
-            std::unique_ptr<T> singleton = std::unique_ptr<T>(new T());
-            auto result = singletons.try_emplace(typeid(T), std::move(singleton));
-            if (!result.second)
-                throw std::runtime_error("Singleton already registered!");
+            auto slot = CreateSingleton<T>([]()
+            { return new T(); }, teardown);
+            Insert(&Registry::tagSingletons, SingletonKey<T>(tag), std::move(slot), "Singleton already registered!");
         }
 
         template<typename T>
-        [[maybe_unused]] void RegisterSingleton(const std::function <std::unique_ptr<Injectable>()>& factoryFunction)
+        [[maybe_unused]] void RegisterSingletonTag(const std::string& tag, Teardown teardown = Teardown::Destroy)
+        {
+            RegisterSingletonTag<T>(GetTagId(tag), teardown);
+        }
+
+        // Integral and enum keys of T are separate from string tags and need no interning or hashing.
+        template<typename T, typename Key, std::enable_if_t<IsTagKey<Key>::value, int> = 0>
+        [[maybe_unused]] void RegisterSingletonTag(Key key, Teardown teardown = Teardown::Destroy)
         {
-            static_assert(std::is_base_of<Injectable, T>::value, "T must be a child of Injectable");
-            auto result = singletons.try_emplace(typeid(T), factoryFunction());
-            if (!result.second)
-                throw std::runtime_error("Singleton already registered!");
+            RegisterSingletonTag<T>([]()
+            { return new T(); }, key, teardown);
         }
 
         template<typename T>
-        [[maybe_unused]] void RegisterSingletonTag(const std::function <std::unique_ptr<Injectable>()>& function, const std::string& tag)
+        [[maybe_unused]] void RegisterSingleton(Teardown teardown = Teardown::Destroy)
+        {
+            auto slot = CreateSingleton<T>([]()
+            { return new T(); }, teardown);
+            Insert(&Registry::singletons, TypeId::Of<T>(), std::move(slot), "Singleton already registered!");
+        }
+
+        // The factory returns a std::unique_ptr or a raw pointer to T, a child of T or an Injectable.
+        template<typename T, typename F>
+        [[maybe_unused]] void RegisterSingleton(const F& factoryFunction, Teardown teardown = Teardown::Destroy)
+        {
+            Insert(&Registry::singletons, TypeId::Of<T>(), CreateSingleton<T>(factoryFunction, teardown),
+                   "Singleton already registered!");
+        }
+
+        template<typename T, typename F>
+        [[maybe_unused]] void RegisterSingletonTag(const F& function, TagId tag, Teardown teardown = Teardown::Destroy)
+        {
+            Insert(&Registry::tagSingletons, SingletonKey<T>(tag), CreateSingleton<T>(function, teardown),
+                   "Singleton already registered!");
+        }
+
+        template<typename T, typename F>
+        [[maybe_unused]] void RegisterSingletonTag(const F& function, const std::string& tag, Teardown teardown = Teardown::Destroy)
+        {
+            RegisterSingletonTag<T>(function, GetTagId(tag), teardown);
+        }
+
+        template<typename T, typename F, typename Key, std::enable_if_t<IsTagKey<Key>::value, int> = 0>
+        [[maybe_unused]] void RegisterSingletonTag(const F& function, Key key, Teardown teardown = Teardown::Destroy)
+        {
+            InsertKeyed(&Registry::keyedSingletons, TypeId::Of<T>(), KeyIndex(key),
+                        CreateSingleton<T>(function, teardown), "Singleton already registered!");
+        }
+
+        // The instance lives in one allocation with its reference counts and stays alive while any
+        // SharedHandle to it exists, even after the Injector is destroyed.
+        template<typename T, typename Impl = T>
+        [[maybe_unused]] void RegisterSharedSingleton(Teardown teardown = Teardown::Destroy)
+        {
+            RegisterSharedSingleton<T>([]()
+            { return Impl(); }, teardown);
+        }
+
+        // The factory returns the instance by value.
+        template<typename T, typename F>
+        [[maybe_unused]] void RegisterSharedSingleton(const F& factoryFunction, Teardown teardown = Teardown::Destroy)
+        {
+            Insert(&Registry::singletons, TypeId::Of<T>(), CreateSharedSingleton<T>(factoryFunction, teardown),
+                   "Singleton already registered!");
+        }
+
+        template<typename T, typename Impl = T>
+        [[maybe_unused]] void RegisterSharedSingletonTag(TagId tag, Teardown teardown = Teardown::Destroy)
+        {
+            RegisterSharedSingletonTag<T>([]()
+            { return Impl(); }, tag, teardown);
+        }
+
+        template<typename T, typename Impl = T>
+        [[maybe_unused]] void RegisterSharedSingletonTag(const std::string& tag, Teardown teardown = Teardown::Destroy)
+        {
+            RegisterSharedSingletonTag<T, Impl>(GetTagId(tag), teardown);
+        }
+
+        template<typename T, typename F>
+        [[maybe_unused]] void RegisterSharedSingletonTag(const F& factoryFunction, TagId tag, Teardown teardown = Teardown::Destroy)
+        {
+            Insert(&Registry::tagSingletons, SingletonKey<T>(tag), CreateSharedSingleton<T>(factoryFunction, teardown),
+                   "Singleton already registered!");
+        }
+
+        template<typename T, typename F>
+        [[maybe_unused]] void RegisterSharedSingletonTag(const F& factoryFunction, const std::string& tag,
+                                                         Teardown teardown = Teardown::Destroy)
+        {
+            RegisterSharedSingletonTag<T>(factoryFunction, GetTagId(tag), teardown);
+        }
+
+        template<class T>
+        SharedHandle<T> ResolveShared()
+        {
+            auto pin = Guard();
+            return SingletonSlot(TypeId::Of<T>()).template GetShared<T>();
+        }
+
+        template<class T>
+        SharedHandle<T> ResolveSharedTag(TagId tag)
+        {
+            return SingletonSlot(SingletonKey<T>(tag)).template GetShared<T>();
+        }
+
+        template<class T>
+        SharedHandle<T> ResolveSharedTag(const std::string& tag)
+        {
+            return SingletonSlot(tag, TypeId::Of<T>()).template GetShared<T>();
+        }
+
+        template<class T>
+        T* ResolveSingletonTag(TagId tag)
         {
-            static_assert(std::is_base_of<Injectable, T>::value, "T must be a child of Injectable");
-            auto result = tagSingletons.try_emplace(tag, function());
+            return SingletonOf<T>(SingletonSlot(SingletonKey<T>(tag)));
+        }
 
-            if (!result.second)
-                throw std::runtime_error("Singleton already registered!");
+        template<class T, typename Key, std::enable_if_t<IsTagKey<Key>::value, int> = 0>
+        T* ResolveSingletonTag(Key key)
+        {
+            auto pin = Guard();
+            auto* slot = FindKeyed(&Registry::keyedSingletons, TypeId::Of<T>(), KeyIndex(key));
+            if (slot == nullptr)
+                ThrowError("Singleton not registered!");
+            ConstructionScope::Resolved(*slot);
+            return SingletonOf<T>(*slot);
         }
 
         template<class T>
         T* ResolveSingletonTag(const std::string& tag)
         {
-            static_assert(std::is_base_of<Injectable, T>::value, "T must be a child of Injectable");
-            auto it = tagSingletons.find(tag);
-            if (it == tagSingletons.end())
-                throw std::runtime_error("Singleton not registered!");
-            auto* result = dynamic_cast<T*>(it->second.get());
-            if(result == nullptr)
-                throw std::runtime_error("Singleton type mismatch!");
-            return result;
+            return SingletonOf<T>(SingletonSlot(tag, TypeId::Of<T>()));
         }
 
         template<class T>
         T* ResolveSingleton()
         {
-            static_assert(std::is_base_of<Injectable, T>::value, "T must be a child of Injectable");
-            auto it = singletons.find(typeid(T));
-            if (it == singletons.end())
-                throw std::runtime_error("Singleton not registered!");
-            auto* result = dynamic_cast<T*>(it->second.get());
-            if(result == nullptr)
-                throw std::runtime_error("Singleton type mismatch!");
+            auto pin = Guard();
+            return SingletonOf<T>(SingletonSlot(TypeId::Of<T>()));
+        }
+
+        // Unlike RegisterSingleton, any number of implementations can be registered for the same interface.
+        template<typename T, typename Impl = T>
+        [[maybe_unused]] void RegisterMulti()
+        {
+            RegisterMulti<T>([]()
+            { return new Impl(); });
+        }
+
+        // The factory returns a std::unique_ptr or a raw pointer to T, a child of T or an Injectable.
+        template<typename T, typename F>
+        [[maybe_unused]] void RegisterMulti(const F& factoryFunction)
+        {
+            auto slot = CreateSingleton<T>(factoryFunction);
+            auto* instance = slot->template Get<T>();
+            if (instance == nullptr)
+                ThrowError("Type mismatch!");
+            AppendMulti<T>([&](MultiBinding<T>& binding)
+            {
+                binding.instances.push_back(instance);
+                binding.owners.push_back(std::move(slot));
+                binding.instanceOwners.push_back(owner.value);
+            });
+        }
+
+        template<typename T, typename Impl = T>
+        [[maybe_unused]] void RegisterMultiTransient()
+        {
+            RegisterMultiTransient<T>([]()
+            { return new Impl(); });
+        }
+
+        // The factory returns a std::unique_ptr or a raw pointer to T or a child of T.
+        template<typename T, typename F>
+        [[maybe_unused]] void RegisterMultiTransient(const F& factoryFunction)
+        {
+            AppendMulti<T>([&](MultiBinding<T>& binding)
+            {
+                binding.factories.emplace_back([factoryFunction]()
+                { return std::unique_ptr<T>(factoryFunction()); });
+                binding.factoryOwners.push_back(owner.value);
+            });
+        }
+
+        // Singletons registered with RegisterMulti in registration order, empty if there are none.
+        // The span stays valid until the next RegisterMulti of T on this Injector.
+        template<class T>
+        Span<T* const> ResolveAll() const
+        {
+            auto* binding = FindMulti<T>();
+            if (binding == nullptr)
+                return {};
+            for (const auto& owner : binding->owners)
+                ConstructionScope::Resolved(*owner);
+            return Span<T* const>(binding->instances.data(), binding->instances.size());
+        }
+
+        // One new instance from every RegisterMultiTransient factory of T, in registration order.
+        template<class T>
+        std::vector<std::unique_ptr<T>> ResolveAllTransient() const
+        {
+            std::vector<std::unique_ptr<T>> result;
+            auto* binding = FindMulti<T>();
+            if (binding == nullptr)
+                return result;
+            result.reserve(binding->factories.size());
+            for (const auto& factory : binding->factories)
+                result.push_back(factory());
             return result;
         }
 
+        // Released instances are reset, when T has a Reset() function, and kept for the next resolve on the
+        // releasing thread. Each thread keeps at most capacity instances. Needs Recycled.h.
+        template<typename T>
+        [[maybe_unused]] void RegisterRecycled();
+
+        // The factory returns a std::unique_ptr or a raw pointer to T or a child of T.
+        template<typename T, typename F>
+        [[maybe_unused]] void RegisterRecycled(const F& factoryFunction, std::size_t capacity = 16);
+
+        // Reuses a released instance of this thread if there is one, the factory is only called otherwise.
+        template<class T>
+        Recycled<T> ResolveRecycled();
+
+        // The factory runs on its own thread the first time T is resolved. It returns a std::unique_ptr or a raw
+        // pointer to T, a child of T or an Injectable, or a std::future of one of them. Needs AsyncSingleton.h.
+        template<typename T, typename F>
+        [[maybe_unused]] void RegisterAsyncSingleton(const F& factoryFunction);
+
+        template<typename T>
+        [[maybe_unused]] void RegisterAsyncSingleton();
+
+        // Starts the construction if it is not running yet. The result keeps the instance alive.
+        template<class T>
+        AsyncResolve<T> ResolveAsync();
+
+        // The factory is called once per shard and returns T by value. Each shard is cache line aligned, so
+        // threads updating different shards do not contend. Meant for write heavy services such as counters and
+        // log buffers, whose shards are combined with ForEachShard. 0 shards are one per hardware thread. Needs
+        // Sharded.h.
+        template<typename T, typename F, std::enable_if_t<std::is_invocable<const F&>::value, int> = 0>
+        [[maybe_unused]] void RegisterSharded(const F& factoryFunction, std::size_t shards = 0, ShardBy by = ShardBy::Thread);
+
+        template<typename T>
+        [[maybe_unused]] void RegisterSharded(std::size_t shards = 0, ShardBy by = ShardBy::Thread);
+
+        // The shard of the calling thread or of the processor it runs on. A thread may get a different shard of
+        // the same registration when it migrates, with ShardBy::Cpu, so shards still need thread safe updates.
+        template<class T>
+        T* ResolveSharded();
+
+        // Calls function with every shard of T in shard order, e.g. to sum counters.
+        template<class T, class F>
+        void ForEachShard(const F& function);
+
+        // Every thread that resolves T gets its own instance, built by the factory on the thread's first
+        // resolve and destroyed when the thread exits or the registration is removed. Needs ThreadLocal.h.
+        template<typename T>
+        [[maybe_unused]] void RegisterThreadLocal();
+
+        // The factory returns a std::unique_ptr or a raw pointer to T, a child of T or an Injectable.
+        template<typename T, typename F>
+        [[maybe_unused]] void RegisterThreadLocal(const F& factoryFunction);
+
+        template<class T>
+        T* ResolveThreadLocal();
+
+        // The factory returns a raw pointer to T, a child of T or an Injectable.
         template<typename T, typename F>
         void RegisterTransient(const F&& factoryLambda)
         {
-            static_assert(std::is_base_of<Injectable, T>::value, "T must be a child of Injectable");
-            std::function factoryFunc{factoryLambda};
-            auto* functionWrapper = new FunctionWrapper(factoryFunc);
-            functionWrapper->template GenerateTypeSignature<T>();
-            auto result = transient.try_emplace(functionWrapper->typeSignature, std::unique_ptr<FunctionWrapperBase>(functionWrapper));
+            auto functionWrapper = CreateFunctionWrapper<T>(factoryLambda);
+            auto signature = functionWrapper->signatureId;
+            Insert(&Registry::transient, signature, std::move(functionWrapper), "Type already registered!");
+        }
 
-            if (!result.second)
-                throw std::runtime_error("Type already registered!");
+        template<typename T, typename F>
+        [[maybe_unused]] void RegisterTransientTag(const F& factoryLambda, TagId tag)
+        {
+            auto functionWrapper = CreateFunctionWrapper<T>(factoryLambda);
+            TaggedKey key{TypeId::Of<T>(), tag.value, functionWrapper->argumentsId};
+            Insert(&Registry::transientTag, key, std::move(functionWrapper), "Type already registered!");
         }
 
         template<typename T, typename F>
         [[maybe_unused]] void RegisterTransientTag(const F& factoryLambda, const std::string& tag)
         {
-            static_assert(std::is_base_of<Injectable, T>::value, "T must be a child of Injectable");
-            std::function factoryFunc{factoryLambda};
-            auto* functionWrapper = new FunctionWrapper(factoryFunc);
-            functionWrapper->template GenerateTypeSignature<T>();
-            auto result = transientTag.try_emplace(tag, std::unique_ptr<FunctionWrapperBase>(functionWrapper));
-
-            if (!result.second)
-                throw std::runtime_error("Type already registered!");
+            RegisterTransientTag<T>(factoryLambda, GetTagId(tag));
         }
 
         template<typename T>
         [[maybe_unused]] void RegisterTransient()
         {
-            RegisterTransient<T>([]() -> Injectable *
+            RegisterTransient<T>([]() -> T *
             { return new T(); });
         }
 
         template<typename T>
-        [[maybe_unused]] void RegisterTransientTag(const std::string& tag)
+        [[maybe_unused]] void RegisterTransientTag(TagId tag)
         {
-            RegisterTransientTag<T>([]() -> Injectable *
+            RegisterTransientTag<T>([]() -> T *
             { return new T(); }, tag);
         }
 
         template<typename T>
-        std::unique_ptr<T> ResolveTransient()
+        [[maybe_unused]] void RegisterTransientTag(const std::string& tag)
         {
-            static_assert(std::is_base_of<Injectable, T>::value, "T must be a child of Injectable");
-            auto it = transient.find(FunctionWrapper<>::template GetTypeSignature<T>());
-            if (it == transient.end())
-                throw std::runtime_error("Type not registered!");
-
-            auto* functionWrapper = dynamic_cast<FunctionWrapper<>*>(it->second.get());
-            if(functionWrapper == nullptr)
-                throw std::runtime_error("Factory function mismatch!");
+            RegisterTransientTag<T>(GetTagId(tag));
+        }
 
-            auto result = dynamic_cast<T*>(functionWrapper->factoryFunc());
-            if(result == nullptr)
-                throw std::runtime_error("Type mismatch!");
-            return std::unique_ptr<T>(result);
+        template<typename T, typename F, typename Key, std::enable_if_t<IsTagKey<Key>::value, int> = 0>
+        [[maybe_unused]] void RegisterTransientTag(const F& factoryLambda, Key key)
+        {
+            InsertKeyed(&Registry::keyedTransients, TypeId::Of<T>(), KeyIndex(key), CreateFunctionWrapper<T>(factoryLambda),
+                        "Type already registered!");
         }
 
+        template<typename T, typename Key, std::enable_if_t<IsTagKey<Key>::value, int> = 0>
+        [[maybe_unused]] void RegisterTransientTag(Key key)
+        {
+            RegisterTransientTag<T>([]() -> T *
+            { return new T(); }, key);
+        }
 
         template<typename T, typename ... Args>
         std::unique_ptr<T> ResolveTransient(Args ... args)
         {
-            static_assert(std::is_base_of<Injectable, T>::value, "T must be a child of Injectable");
-            auto it = transient.find(FunctionWrapper<Args ...>::template GetTypeSignature<T>());
-            if (it == transient.end())
-                throw std::runtime_error("Type not registered!");
+            auto scope = Trace<T>("Resolve");
+            auto pin = Guard();
+            auto& functionWrapper = Factory<Args...>(TransientWrapper(FunctionWrapper<Args ...>::template GetTypeSignature<T>()));
+            return functionWrapper.template Cast<T>(functionWrapper.factoryFunc(std::move(args) ...));
+        }
 
-            auto* functionWrapper = dynamic_cast<FunctionWrapper<Args...>*>(it->second.get());
-            if(functionWrapper == nullptr)
-                throw std::runtime_error("Factory function mismatch!");
+        // The factory returns T by value. Resolving it never allocates.
+        template<typename T, typename F>
+        [[maybe_unused]] void RegisterValue(const F& factoryLambda)
+        {
+            RegisterValue<T>(std::function{factoryLambda});
+        }
 
-            auto result = dynamic_cast<T*>(functionWrapper->factoryFunc(std::move(args) ...));
-            if(result == nullptr)
-                throw std::runtime_error("Type mismatch!");
-            return std::unique_ptr<T>(result);
+        template<typename T>
+        [[maybe_unused]] void RegisterValue()
+        {
+            RegisterValue<T>([]() -> T
+            { return T(); });
         }
 
         template<typename T, typename ... Args>
-        std::unique_ptr<T> ResolveTransientTag(const std::string& tag, Args ... args)
+        T ResolveValue(Args ... args)
         {
-            static_assert(std::is_base_of<Injectable, T>::value, "T must be a child of Injectable");
-            auto it = transientTag.find(tag);
-            if (it == transientTag.end())
-                throw std::runtime_error("Type not registered!");
+            auto scope = Trace<T>("Resolve");
+            auto* entry = Find(&Registry::values, TypeId::Of<ValueFunctionWrapper<T, Args...>>());
+            if (entry == nullptr)
+                ThrowError("Type not registered!");
 
-            auto* functionWrapper = dynamic_cast<FunctionWrapper<Args...>*>(it->second.get());
-            if(functionWrapper == nullptr)
-                throw std::runtime_error("Factory function mismatch!");
+            auto* functionWrapper = entry->template To<ValueFunctionWrapper<T, Args...>>();
+            if (functionWrapper == nullptr)
+                ThrowError("Factory function mismatch!");
+            return functionWrapper->factoryFunc(std::move(args) ...);
+        }
 
-            auto result = dynamic_cast<T*>(functionWrapper->factoryFunc(std::move(args) ...));
-            if(result == nullptr)
-                throw std::runtime_error("Type mismatch!");
-            return std::unique_ptr<T>(result);
+        // The factory takes the storage followed by the arguments and placement constructs its product,
+        // e.g. [](void* storage, int a) { return new (storage) Impl(a); }. Its return type sets the layout.
+        template<typename T, typename F>
+        [[maybe_unused]] void RegisterTransientInto(const F& factoryLambda)
+        {
+            using FunctionType = decltype(std::function{factoryLambda});
+            auto functionWrapper = CreatePlacementWrapper<T>(factoryLambda, static_cast<FunctionType*>(nullptr));
+            auto signature = functionWrapper->signatureId;
+            Insert(&Registry::placementTransient, signature, std::move(functionWrapper), "Type already registered!");
+        }
+
+        template<typename T, typename Impl = T>
+        [[maybe_unused]] void RegisterTransientInto()
+        {
+            RegisterTransientInto<T>([](void* storage) -> Impl *
+            { return new (storage) Impl(); });
+        }
+
+        template<typename T, typename F>
+        [[maybe_unused]] void RegisterTransientIntoTag(const F& factoryLambda, TagId tag)
+        {
+            using FunctionType = decltype(std::function{factoryLambda});
+            Insert(&Registry::placementTransientTag, tag, CreatePlacementWrapper<T>(factoryLambda, static_cast<FunctionType*>(nullptr)),
+                   "Type already registered!");
+        }
+
+        template<typename T, typename F>
+        [[maybe_unused]] void RegisterTransientIntoTag(const F& factoryLambda, const std::string& tag)
+        {
+            RegisterTransientIntoTag<T>(factoryLambda, GetTagId(tag));
+        }
+
+        template<typename T, typename Impl = T>
+        [[maybe_unused]] void RegisterTransientIntoTag(const std::string& tag)
+        {
+            RegisterTransientIntoTag<T>([](void* storage) -> Impl *
+            { return new (storage) Impl(); }, tag);
+        }
+
+        template<typename T, typename ... Args>
+        StorageLayout GetTransientLayout()
+        {
+            return FindPlacementWrapper<T, Args...>()->layout;
+        }
+
+        template<typename ... Args>
+        StorageLayout GetTransientLayoutTag(TagId tag)
+        {
+            return FindPlacementWrapper<Args...>(tag)->layout;
+        }
+
+        template<typename ... Args>
+        StorageLayout GetTransientLayoutTag(const std::string& tag)
+        {
+            return FindPlacementWrapper<Args...>(tag)->layout;
+        }
+
+        // Constructs the product in storage of at least size bytes. The caller runs its destructor.
+        template<typename T, typename ... Args>
+        T* ResolveTransientInto(void* storage, std::size_t size, Args ... args)
+        {
+            auto scope = Trace<T>("Resolve");
+            return FindPlacementWrapper<T, Args...>()->template Construct<T>(storage, size, std::move(args) ...);
+        }
+
+        template<typename T, typename ... Args>
+        T* ResolveTransientIntoTag(TagId tag, void* storage, std::size_t size, Args ... args)
+        {
+            auto scope = Trace<T>("Resolve");
+            return FindPlacementWrapper<Args...>(tag)->template Construct<T>(storage, size, std::move(args) ...);
+        }
+
+        template<typename T, typename ... Args>
+        T* ResolveTransientIntoTag(const std::string& tag, void* storage, std::size_t size, Args ... args)
+        {
+            auto scope = Trace<T>("Resolve");
+            return FindPlacementWrapper<Args...>(tag)->template Construct<T>(storage, size, std::move(args) ...);
+        }
+
+        template<typename T, typename ... Args>
+        std::unique_ptr<T> ResolveTransientTag(TagId tag, Args ... args)
+        {
+            auto scope = Trace<T>("Resolve");
+            auto& functionWrapper = Factory<Args...>(TransientWrapper(TransientKey<T, Args...>(tag)));
+            return functionWrapper.template Cast<T>(functionWrapper.factoryFunc(std::move(args) ...));
+        }
+
+        template<typename T, typename ... Args>
+        std::unique_ptr<T> ResolveTransientTag(const std::string& tag, Args ... args)
+        {
+            auto scope = Trace<T>("Resolve");
+            auto& functionWrapper = Factory<Args...>(TransientWrapper(tag, TypeId::Of<T>(), TypeId::Of<FunctionWrapper<Args...>>()));
+            return functionWrapper.template Cast<T>(functionWrapper.factoryFunc(std::move(args) ...));
+        }
+
+        template<typename T, typename ... Args, typename Key, std::enable_if_t<IsTagKey<Key>::value, int> = 0>
+        std::unique_ptr<T> ResolveTransientTag(Key key, Args ... args)
+        {
+            auto scope = Trace<T>("Resolve");
+            auto pin = Guard();
+            auto* entry = FindKeyed(&Registry::keyedTransients, TypeId::Of<T>(), KeyIndex(key));
+            if (entry == nullptr)
+                ThrowError("Type not registered!");
+            auto& functionWrapper = Factory<Args...>(*entry);
+            return functionWrapper.template Cast<T>(functionWrapper.factoryFunc(std::move(args) ...));
         }
     };
 }
 
-inline LiiInjector::Injector* const LiiInjector::Injector::instance = new LiiInjector::Injector();
-
 #endif //LIIINJECTOR_INJECTOR_HPP
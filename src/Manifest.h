@@ -0,0 +1,158 @@
+#ifndef LIIINJECTOR_MANIFEST_H
+#define LIIINJECTOR_MANIFEST_H
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <stdexcept>
+#include <string_view>
+
+namespace LiiInjector
+{
+    enum class ManifestKind : std::uint32_t
+    {
+        Singleton = 0,
+        Transient = 1
+    };
+
+    // Binary layout of a manifest, read in place. Fields are in the byte order of the machine that wrote the manifest,
+    // a manifest of the other byte order is rejected by its version field.
+    //   ManifestHeader
+    //   ManifestEntry[entryCount]
+    //   std::uint32_t buckets[bucketCount], entry index + 1 or 0 for an empty bucket
+    //   tag names, not terminated
+    struct ManifestHeader
+    {
+        char magic[4];
+        std::uint32_t version;
+        std::uint32_t entryCount;
+        std::uint32_t bucketCount;
+        std::uint32_t bucketsOffset;
+        std::uint32_t namesOffset;
+    };
+
+    struct ManifestEntry
+    {
+        std::uint64_t hash;
+        std::uint32_t nameOffset;
+        std::uint32_t nameLength;
+        std::uint32_t factoryId;
+        ManifestKind kind;
+
+        std::string_view Name(const char* names) const
+        {
+            return std::string_view(names + nameOffset, nameLength);
+        }
+    };
+
+    inline constexpr char manifestMagic[4] = {'L', 'I', 'I', 'M'};
+    inline constexpr std::uint32_t manifestVersion = 1;
+    // manifestVersion as read from a manifest written on a machine of the other byte order.
+    inline constexpr std::uint32_t swappedManifestVersion = (manifestVersion << 24) | ((manifestVersion & 0xFF00u) << 8) |
+                                                            ((manifestVersion >> 8) & 0xFF00u) | (manifestVersion >> 24);
+
+    // FNV-1a, stable across platforms and runs unlike std::hash.
+    inline std::uint64_t ManifestHash(std::string_view tag)
+    {
+        std::uint64_t hash = 14695981039346656037ull;
+        for (char character : tag)
+        {
+            hash ^= static_cast<unsigned char>(character);
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+
+    // Read only view of a manifest. Nothing is copied, the bytes have to outlive the Manifest.
+    class Manifest
+    {
+    private:
+        const ManifestHeader* header = nullptr;
+        const ManifestEntry* entries = nullptr;
+        const std::uint32_t* buckets = nullptr;
+        const char* names = nullptr;
+    public:
+        // Validates the bounds of every entry and the probe table, so a corrupt file throws instead of reading out
+        // of range or probing forever.
+        Manifest(const void* data, std::size_t size)
+        {
+            if (size < sizeof(ManifestHeader) || reinterpret_cast<std::uintptr_t>(data) % alignof(ManifestEntry) != 0)
+                throw std::runtime_error("Invalid manifest!");
+            header = static_cast<const ManifestHeader*>(data);
+            if (std::memcmp(header->magic, manifestMagic, sizeof(manifestMagic)) != 0)
+                throw std::runtime_error("Invalid manifest!");
+            if (header->version == swappedManifestVersion)
+                throw std::runtime_error("Manifest byte order mismatch!");
+            if (header->version != manifestVersion)
+                throw std::runtime_error("Invalid manifest!");
+
+            auto entriesEnd = sizeof(ManifestHeader) + std::uint64_t{header->entryCount} * sizeof(ManifestEntry);
+            auto bucketsEnd = std::uint64_t{header->bucketsOffset} + std::uint64_t{header->bucketCount} * sizeof(std::uint32_t);
+            if (header->bucketCount == 0 || (header->bucketCount & (header->bucketCount - 1)) != 0 ||
+                header->bucketCount <= header->entryCount || header->bucketsOffset < entriesEnd ||
+                header->bucketsOffset % alignof(std::uint32_t) != 0 || header->namesOffset < bucketsEnd ||
+                header->namesOffset > size)
+                throw std::runtime_error("Invalid manifest!");
+
+            auto* bytes = static_cast<const char*>(data);
+            entries = reinterpret_cast<const ManifestEntry*>(bytes + sizeof(ManifestHeader));
+            buckets = reinterpret_cast<const std::uint32_t*>(bytes + header->bucketsOffset);
+            names = bytes + header->namesOffset;
+
+            auto namesSize = size - header->namesOffset;
+            for (std::uint32_t i = 0; i < header->entryCount; i++)
+            {
+                if (std::uint64_t{entries[i].nameOffset} + entries[i].nameLength > namesSize)
+                    throw std::runtime_error("Invalid manifest!");
+            }
+            // Find stops probing at an empty bucket, without one a missing tag would probe forever.
+            bool empty = false;
+            for (std::uint32_t i = 0; i < header->bucketCount; i++)
+            {
+                if (buckets[i] > header->entryCount)
+                    throw std::runtime_error("Invalid manifest!");
+                empty = empty || buckets[i] == 0;
+            }
+            if (!empty)
+                throw std::runtime_error("Invalid manifest!");
+        }
+
+        // Probes the prebuilt table, the tag is neither copied nor interned.
+        const ManifestEntry* Find(std::string_view tag) const
+        {
+            auto hash = ManifestHash(tag);
+            auto mask = header->bucketCount - 1;
+            for (auto bucket = static_cast<std::uint32_t>(hash) & mask;; bucket = (bucket + 1) & mask)
+            {
+                if (buckets[bucket] == 0)
+                    return nullptr;
+                const auto& entry = entries[buckets[bucket] - 1];
+                if (entry.hash == hash && entry.Name(names) == tag)
+                    return &entry;
+            }
+        }
+
+        std::string_view Name(const ManifestEntry& entry) const
+        {
+            return entry.Name(names);
+        }
+
+        const ManifestEntry* begin() const
+        {
+            return entries;
+        }
+
+        const ManifestEntry* end() const
+        {
+            return entries + header->entryCount;
+        }
+
+        std::size_t Size() const
+        {
+            return header->entryCount;
+        }
+    };
+}
+
+#endif //LIIINJECTOR_MANIFEST_H
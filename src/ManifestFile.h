@@ -0,0 +1,183 @@
+#ifndef LIIINJECTOR_MANIFESTFILE_H
+#define LIIINJECTOR_MANIFESTFILE_H
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include "Manifest.h"
+
+namespace LiiInjector
+{
+    // Builds the binary form of a manifest, used by the manifest compiler.
+    class ManifestWriter
+    {
+    private:
+        struct Binding
+        {
+            std::string tag;
+            ManifestKind kind;
+            std::uint32_t factoryId;
+        };
+
+        std::vector<Binding> bindings;
+
+        template<class T>
+        static void Append(std::vector<char>& output, const T& value)
+        {
+            auto* bytes = reinterpret_cast<const char*>(&value);
+            output.insert(output.end(), bytes, bytes + sizeof(T));
+        }
+    public:
+        void Add(std::string tag, ManifestKind kind, std::uint32_t factoryId)
+        {
+            for (const auto& binding : bindings)
+            {
+                if (binding.tag == tag)
+                    throw std::runtime_error("Tag already in manifest!");
+            }
+            bindings.push_back(Binding{std::move(tag), kind, factoryId});
+        }
+
+        std::vector<char> Build() const
+        {
+            // At most half full, so probes stay short.
+            std::uint32_t bucketCount = 2;
+            while (bucketCount < bindings.size() * 2)
+                bucketCount *= 2;
+
+            ManifestHeader header{};
+            std::memcpy(header.magic, manifestMagic, sizeof(manifestMagic));
+            header.version = manifestVersion;
+            header.entryCount = static_cast<std::uint32_t>(bindings.size());
+            header.bucketCount = bucketCount;
+            header.bucketsOffset = static_cast<std::uint32_t>(sizeof(ManifestHeader) + bindings.size() * sizeof(ManifestEntry));
+            header.namesOffset = header.bucketsOffset + bucketCount * static_cast<std::uint32_t>(sizeof(std::uint32_t));
+
+            std::vector<std::uint32_t> buckets(bucketCount, 0);
+            std::vector<char> output;
+            Append(output, header);
+            std::uint32_t nameOffset = 0;
+            for (std::uint32_t i = 0; i < bindings.size(); i++)
+            {
+                const auto& binding = bindings[i];
+                ManifestEntry entry{ManifestHash(binding.tag), nameOffset, static_cast<std::uint32_t>(binding.tag.size()),
+                                    binding.factoryId, binding.kind};
+                Append(output, entry);
+                nameOffset += entry.nameLength;
+
+                auto bucket = static_cast<std::uint32_t>(entry.hash) & (bucketCount - 1);
+                while (buckets[bucket] != 0)
+                    bucket = (bucket + 1) & (bucketCount - 1);
+                buckets[bucket] = i + 1;
+            }
+            for (auto bucket : buckets)
+                Append(output, bucket);
+            for (const auto& binding : bindings)
+                output.insert(output.end(), binding.tag.begin(), binding.tag.end());
+            return output;
+        }
+    };
+
+
+    // Read only memory mapping of a whole file.
+    class MappedFile
+    {
+    private:
+        const void* data = nullptr;
+        std::size_t size = 0;
+#ifdef _WIN32
+        HANDLE file = INVALID_HANDLE_VALUE;
+        HANDLE mapping = nullptr;
+#endif
+
+        void Unmap()
+        {
+#ifdef _WIN32
+            if (data != nullptr)
+                UnmapViewOfFile(data);
+            if (mapping != nullptr)
+                CloseHandle(mapping);
+            if (file != INVALID_HANDLE_VALUE)
+                CloseHandle(file);
+            file = INVALID_HANDLE_VALUE;
+            mapping = nullptr;
+#else
+            if (data != nullptr)
+                munmap(const_cast<void*>(data), size);
+#endif
+            data = nullptr;
+            size = 0;
+        }
+    public:
+        explicit MappedFile(const std::string& path)
+        {
+#ifdef _WIN32
+            file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+            LARGE_INTEGER fileSize{};
+            if (file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+            {
+                Unmap();
+                throw std::runtime_error("Cannot map file!");
+            }
+            mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            data = mapping == nullptr ? nullptr : MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+            if (data == nullptr)
+            {
+                Unmap();
+                throw std::runtime_error("Cannot map file!");
+            }
+            size = static_cast<std::size_t>(fileSize.QuadPart);
+#else
+            int descriptor = open(path.c_str(), O_RDONLY);
+            struct stat status{};
+            if (descriptor < 0 || fstat(descriptor, &status) != 0 || status.st_size == 0)
+            {
+                if (descriptor >= 0)
+                    close(descriptor);
+                throw std::runtime_error("Cannot map file!");
+            }
+            auto* mapped = mmap(nullptr, static_cast<std::size_t>(status.st_size), PROT_READ, MAP_PRIVATE, descriptor, 0);
+            close(descriptor);
+            if (mapped == MAP_FAILED)
+                throw std::runtime_error("Cannot map file!");
+            data = mapped;
+            size = static_cast<std::size_t>(status.st_size);
+#endif
+        }
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        ~MappedFile()
+        {
+            Unmap();
+        }
+
+        const void* Data() const
+        {
+            return data;
+        }
+
+        std::size_t Size() const
+        {
+            return size;
+        }
+    };
+}
+
+#endif //LIIINJECTOR_MANIFESTFILE_H
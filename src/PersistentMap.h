@@ -0,0 +1,389 @@
+#ifndef LIIINJECTOR_PERSISTENTMAP_H
+#define LIIINJECTOR_PERSISTENTMAP_H
+
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace LiiInjector
+{
+    // Hash array mapped trie with structural sharing. Nodes are immutable, so copying a map copies one
+    // pointer and a write only copies the nodes on the path to the changed entry.
+    template<class Key, class Value, class Hash = std::hash<Key>>
+    class PersistentMap
+    {
+    private:
+        static constexpr std::uint32_t bitsPerLevel = 5;
+        static constexpr std::uint32_t hashBits = sizeof(std::size_t) * 8;
+
+        struct Entry
+        {
+            std::size_t hash;
+            Key key;
+            Value value;
+        };
+
+        struct Node;
+        using NodePtr = std::shared_ptr<const Node>;
+
+        // Entries and children are stored compacted, indexed by the population count of their bitmap.
+        // Nodes past the last hash level hold colliding entries in a plain list.
+        struct Node
+        {
+            std::uint32_t entryMap = 0;
+            std::uint32_t childMap = 0;
+            std::vector<Entry> entries;
+            std::vector<NodePtr> children;
+        };
+
+        NodePtr root;
+        std::size_t size = 0;
+
+        static std::uint32_t BitCount(std::uint32_t value)
+        {
+            value = value - ((value >> 1) & 0x55555555u);
+            value = (value & 0x33333333u) + ((value >> 2) & 0x33333333u);
+            return (((value + (value >> 4)) & 0x0F0F0F0Fu) * 0x01010101u) >> 24;
+        }
+
+        static std::uint32_t Bit(std::size_t hash, std::uint32_t shift)
+        {
+            return 1u << ((hash >> shift) & ((1u << bitsPerLevel) - 1));
+        }
+
+        static std::uint32_t Index(std::uint32_t bitmap, std::uint32_t bit)
+        {
+            return BitCount(bitmap & (bit - 1));
+        }
+
+        static NodePtr Pair(Entry first, Entry second, std::uint32_t shift)
+        {
+            auto node = std::make_shared<Node>();
+            if (shift >= hashBits)
+            {
+                node->entries.push_back(std::move(first));
+                node->entries.push_back(std::move(second));
+                return node;
+            }
+
+            auto firstBit = Bit(first.hash, shift);
+            auto secondBit = Bit(second.hash, shift);
+            if (firstBit == secondBit)
+            {
+                node->childMap = firstBit;
+                node->children.push_back(Pair(std::move(first), std::move(second), shift + bitsPerLevel));
+                return node;
+            }
+
+            node->entryMap = firstBit | secondBit;
+            if (firstBit < secondBit)
+            {
+                node->entries.push_back(std::move(first));
+                node->entries.push_back(std::move(second));
+            }
+            else
+            {
+                node->entries.push_back(std::move(second));
+                node->entries.push_back(std::move(first));
+            }
+            return node;
+        }
+
+        static NodePtr Set(const Node* node, Entry entry, std::uint32_t shift, bool& inserted)
+        {
+            if (node == nullptr)
+            {
+                auto created = std::make_shared<Node>();
+                if (shift < hashBits)
+                    created->entryMap = Bit(entry.hash, shift);
+                created->entries.push_back(std::move(entry));
+                inserted = true;
+                return created;
+            }
+
+            auto copy = std::make_shared<Node>(*node);
+            if (shift >= hashBits)
+            {
+                for (auto& existing : copy->entries)
+                {
+                    if (existing.key == entry.key)
+                    {
+                        existing.value = std::move(entry.value);
+                        return copy;
+                    }
+                }
+                copy->entries.push_back(std::move(entry));
+                inserted = true;
+                return copy;
+            }
+
+            auto bit = Bit(entry.hash, shift);
+            if (copy->entryMap & bit)
+            {
+                auto index = Index(copy->entryMap, bit);
+                auto& existing = copy->entries[index];
+                if (existing.key == entry.key)
+                {
+                    existing.value = std::move(entry.value);
+                    return copy;
+                }
+
+                auto child = Pair(std::move(existing), std::move(entry), shift + bitsPerLevel);
+                copy->entries.erase(copy->entries.begin() + index);
+                copy->entryMap &= ~bit;
+                copy->childMap |= bit;
+                copy->children.insert(copy->children.begin() + Index(copy->childMap, bit), std::move(child));
+                inserted = true;
+                return copy;
+            }
+
+            if (copy->childMap & bit)
+            {
+                auto& child = copy->children[Index(copy->childMap, bit)];
+                child = Set(child.get(), std::move(entry), shift + bitsPerLevel, inserted);
+                return copy;
+            }
+
+            copy->entryMap |= bit;
+            copy->entries.insert(copy->entries.begin() + Index(copy->entryMap, bit), std::move(entry));
+            inserted = true;
+            return copy;
+        }
+        // Returns node itself when key is not in it and nullptr when nothing is left. A child reduced to a single
+        // entry is pulled into its parent, so a map looks the same however it reached its contents.
+        static NodePtr Erase(const NodePtr& node, const Key& key, std::size_t hash, std::uint32_t shift, bool& erased)
+        {
+            if (node == nullptr)
+                return node;
+
+            if (shift >= hashBits)
+            {
+                for (std::size_t index = 0; index < node->entries.size(); index++)
+                {
+                    if (node->entries[index].key == key)
+                    {
+                        erased = true;
+                        if (node->entries.size() == 1)
+                            return nullptr;
+                        auto copy = std::make_shared<Node>(*node);
+                        copy->entries.erase(copy->entries.begin() + index);
+                        return copy;
+                    }
+                }
+                return node;
+            }
+
+            auto bit = Bit(hash, shift);
+            if (node->entryMap & bit)
+            {
+                auto index = Index(node->entryMap, bit);
+                if (!(node->entries[index].key == key))
+                    return node;
+                erased = true;
+                if (node->entries.size() == 1 && node->children.empty())
+                    return nullptr;
+                auto copy = std::make_shared<Node>(*node);
+                copy->entries.erase(copy->entries.begin() + index);
+                copy->entryMap &= ~bit;
+                return copy;
+            }
+
+            if (!(node->childMap & bit))
+                return node;
+            auto childIndex = Index(node->childMap, bit);
+            auto child = Erase(node->children[childIndex], key, hash, shift + bitsPerLevel, erased);
+            if (!erased)
+                return node;
+
+            auto copy = std::make_shared<Node>(*node);
+            if (child != nullptr && (child->entries.size() > 1 || !child->children.empty()))
+            {
+                copy->children[childIndex] = std::move(child);
+                return copy;
+            }
+            copy->children.erase(copy->children.begin() + childIndex);
+            copy->childMap &= ~bit;
+            if (child != nullptr)
+            {
+                copy->entryMap |= bit;
+                copy->entries.insert(copy->entries.begin() + Index(copy->entryMap, bit), child->entries.front());
+            }
+            if (copy->entries.empty() && copy->children.empty())
+                return nullptr;
+            return copy;
+        }
+
+        template<class F>
+        static void ForEach(const Node* node, const F& function)
+        {
+            if (node == nullptr)
+                return;
+            for (const auto& entry : node->entries)
+                function(entry);
+            for (const auto& child : node->children)
+                ForEach(child.get(), function);
+        }
+
+        // Entries ordered by their hash chunks from the root down, so every node's entries form one range.
+        static bool TrieOrder(const Entry& first, const Entry& second)
+        {
+            for (std::uint32_t shift = 0; shift < hashBits; shift += bitsPerLevel)
+            {
+                auto firstBit = Bit(first.hash, shift);
+                auto secondBit = Bit(second.hash, shift);
+                if (firstBit != secondBit)
+                    return firstBit < secondBit;
+            }
+            return false;
+        }
+
+        static NodePtr Build(std::vector<Entry>& entries, std::size_t first, std::size_t last, std::uint32_t shift)
+        {
+            auto node = std::make_shared<Node>();
+            if (shift >= hashBits)
+            {
+                node->entries.assign(entries.begin() + first, entries.begin() + last);
+                return node;
+            }
+
+            std::uint32_t entryCount = 0;
+            std::uint32_t childCount = 0;
+            for (auto begin = first; begin < last;)
+            {
+                auto end = begin + 1;
+                while (end < last && Bit(entries[end].hash, shift) == Bit(entries[begin].hash, shift))
+                    end++;
+                (end - begin == 1 ? entryCount : childCount)++;
+                begin = end;
+            }
+            node->entries.reserve(entryCount);
+            node->children.reserve(childCount);
+
+            for (auto begin = first; begin < last;)
+            {
+                auto bit = Bit(entries[begin].hash, shift);
+                auto end = begin + 1;
+                while (end < last && Bit(entries[end].hash, shift) == bit)
+                    end++;
+                if (end - begin == 1)
+                {
+                    node->entryMap |= bit;
+                    node->entries.push_back(std::move(entries[begin]));
+                }
+                else
+                {
+                    node->childMap |= bit;
+                    node->children.push_back(Build(entries, begin, end, shift + bitsPerLevel));
+                }
+                begin = end;
+            }
+            return node;
+        }
+    public:
+        const Value* Find(const Key& key) const
+        {
+            return Find(key, Hash{}(key));
+        }
+
+        // For callers that know the hash already, it has to be what Hash returns for key. Lookup only has to compare
+        // equal to Key, so no Key is built for the lookup.
+        template<class Lookup>
+        const Value* Find(const Lookup& key, std::size_t hash) const
+        {
+            auto* node = root.get();
+            std::uint32_t shift = 0;
+            while (node != nullptr)
+            {
+                if (shift >= hashBits)
+                {
+                    for (const auto& entry : node->entries)
+                    {
+                        if (entry.key == key)
+                            return &entry.value;
+                    }
+                    return nullptr;
+                }
+
+                auto bit = Bit(hash, shift);
+                if (node->entryMap & bit)
+                {
+                    const auto& entry = node->entries[Index(node->entryMap, bit)];
+                    return entry.key == key ? &entry.value : nullptr;
+                }
+                if (!(node->childMap & bit))
+                    return nullptr;
+                node = node->children[Index(node->childMap, bit)].get();
+                shift += bitsPerLevel;
+            }
+            return nullptr;
+        }
+
+        // Inserts or replaces the value of key. Copies of this map are not affected.
+        void Set(const Key& key, Value value)
+        {
+            Set(key, std::move(value), Hash{}(key));
+        }
+
+        void Set(const Key& key, Value value, std::size_t hash)
+        {
+            bool inserted = false;
+            root = Set(root.get(), Entry{hash, key, std::move(value)}, 0, inserted);
+            if (inserted)
+                size++;
+        }
+
+        bool Insert(const Key& key, Value value)
+        {
+            if (Find(key) != nullptr)
+                return false;
+            Set(key, std::move(value));
+            return true;
+        }
+
+        // Returns false when key was not in the map. Copies of this map are not affected.
+        bool Erase(const Key& key)
+        {
+            bool erased = false;
+            root = Erase(root, key, Hash{}(key), 0, erased);
+            if (erased)
+                size--;
+            return erased;
+        }
+
+        // Calls function(key, value) for every entry, in no particular order.
+        template<class F>
+        void ForEach(const F& function) const
+        {
+            ForEach(root.get(), [&](const Entry& entry)
+            { function(entry.key, entry.value); });
+        }
+
+        // Rebuilds the trie with newly allocated nodes in depth first order, shared with no other map. Lookups
+        // stay local after a long history of writes and erases, at the cost of the sharing with copies.
+        PersistentMap Compacted() const
+        {
+            std::vector<Entry> entries;
+            entries.reserve(size);
+            ForEach(root.get(), [&](const Entry& entry)
+            { entries.push_back(entry); });
+            std::sort(entries.begin(), entries.end(), TrieOrder);
+
+            PersistentMap result;
+            if (!entries.empty())
+                result.root = Build(entries, 0, entries.size(), 0);
+            result.size = size;
+            return result;
+        }
+
+        std::size_t Size() const
+        {
+            return size;
+        }
+    };
+}
+
+#endif //LIIINJECTOR_PERSISTENTMAP_H
@@ -0,0 +1,136 @@
+#ifndef LIIINJECTOR_RECYCLED_H
+#define LIIINJECTOR_RECYCLED_H
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "ThreadLocal.h"
+
+namespace LiiInjector
+{
+    template<class T, class = void>
+    struct HasReset : std::false_type
+    {
+    };
+
+    template<class T>
+    struct HasReset<T, std::void_t<decltype(std::declval<T&>().Reset())>> : std::true_type
+    {
+    };
+
+    class RecycledRegistrationBase
+    {
+    public:
+        explicit RecycledRegistrationBase(const char* typeName) :
+                typeName(typeName)
+        {
+        }
+
+        virtual ~RecycledRegistrationBase() = default;
+
+        // TypeId::Name of T.
+        const char* typeName;
+    };
+
+    // Free lists of a recycled registration, one per thread and bounded by capacity.
+    template<class T>
+    class RecycledRegistration final : public RecycledRegistrationBase
+    {
+    private:
+        struct Pool
+        {
+            std::vector<std::unique_ptr<T>> free;
+        };
+
+        std::function<std::unique_ptr<T>()> factoryFunc;
+        std::size_t capacity;
+        ThreadLocalRegistration pools;
+
+        Pool& ThreadPool() const
+        {
+            return *pools.Get().template Get<Pool>();
+        }
+    public:
+        RecycledRegistration(std::function<std::unique_ptr<T>()> factoryFunc, std::size_t capacity) :
+                RecycledRegistrationBase(TypeId::Name<T>()), factoryFunc(std::move(factoryFunc)), capacity(capacity), pools([]()
+        { return InstanceSlot::Adopt<Pool>(new Pool()); })
+        {
+        }
+
+        std::unique_ptr<T> Acquire() const
+        {
+            auto& pool = ThreadPool();
+            if (pool.free.empty())
+                return factoryFunc();
+            auto instance = std::move(pool.free.back());
+            pool.free.pop_back();
+            return instance;
+        }
+
+        // Goes to the free list of the releasing thread, or is destroyed when that list is full.
+        void Recycle(T* instance) const
+        {
+            std::unique_ptr<T> owned(instance);
+            if constexpr (HasReset<T>::value)
+                owned->Reset();
+            auto& pool = ThreadPool();
+            if (pool.free.size() < capacity)
+                pool.free.push_back(std::move(owned));
+        }
+    };
+
+    // Deleter of a recycled instance. Keeps the registration alive, so handles may outlive their Injector.
+    template<class T>
+    class Recycler
+    {
+    private:
+        std::shared_ptr<const RecycledRegistration<T>> registration;
+    public:
+        Recycler() = default;
+
+        explicit Recycler(std::shared_ptr<const RecycledRegistration<T>> registration) :
+                registration(std::move(registration))
+        {
+        }
+
+        void operator()(T* instance) const
+        {
+            registration->Recycle(instance);
+        }
+    };
+
+
+    template<typename T>
+    void Injector::RegisterRecycled()
+    {
+        RegisterRecycled<T>([]()
+        { return new T(); });
+    }
+
+    template<typename T, typename F>
+    void Injector::RegisterRecycled(const F& factoryFunction, std::size_t capacity)
+    {
+        auto registration = std::make_shared<RecycledRegistration<T>>([factoryFunction]()
+        { return std::unique_ptr<T>(factoryFunction()); }, capacity);
+        Insert(&Registry::recycled, TypeId::Of<T>(), std::shared_ptr<RecycledRegistrationBase>(std::move(registration)),
+               "Type already registered!");
+    }
+
+    template<class T>
+    Recycled<T> Injector::ResolveRecycled()
+    {
+        auto pin = Guard();
+        auto* entry = View().recycled.Find(TypeId::Of<T>());
+        if (entry == nullptr)
+            ThrowError("Type not registered!");
+        Checked<T, const RecycledRegistration<T>>(entry->get());
+        auto registration = std::static_pointer_cast<const RecycledRegistration<T>>(*entry);
+        auto instance = registration->Acquire();
+        return Recycled<T>(instance.release(), Recycler<T>(std::move(registration)));
+    }
+}
+
+#endif //LIIINJECTOR_RECYCLED_H
@@ -0,0 +1,156 @@
+#ifndef LIIINJECTOR_SHARDED_H
+#define LIIINJECTOR_SHARDED_H
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <thread>
+#include <type_traits>
+#ifdef __linux__
+#include <sched.h>
+#elif defined(_WIN32)
+// Declared like processthreadsapi.h does, windows.h would hand its macros to every includer.
+extern "C" __declspec(dllimport) unsigned long __stdcall GetCurrentProcessorNumber();
+#endif
+#include "Injector.hpp"
+
+namespace LiiInjector
+{
+    // Shards are aligned to and padded to this, two cache lines on most targets, so neighbouring shards never
+    // share a line even with adjacent line prefetching.
+    inline constexpr std::size_t shardAlignment = 128;
+
+    class ShardedBase
+    {
+    private:
+        static std::size_t CpuIndex()
+        {
+#ifdef _WIN32
+            return GetCurrentProcessorNumber();
+#elif defined(__linux__)
+            auto cpu = sched_getcpu();
+            return cpu < 0 ? ThreadIndex() : static_cast<std::size_t>(cpu);
+#else
+            return ThreadIndex();
+#endif
+        }
+    protected:
+        static std::size_t Index(ShardBy by, std::size_t count)
+        {
+            auto index = by == ShardBy::Cpu ? CpuIndex() : ThreadIndex();
+            return index < count ? index : index % count;
+        }
+    public:
+        explicit ShardedBase(const char* typeName) :
+                typeName(typeName)
+        {
+        }
+
+        virtual ~ShardedBase() = default;
+
+        // TypeId::Name of T.
+        const char* typeName;
+    };
+
+    // count instances of T, each on its own cache lines. The instances are never moved, so T may hold atomics.
+    template<class T>
+    class Sharded final : public ShardedBase
+    {
+    private:
+        struct alignas(shardAlignment) Shard
+        {
+            T instance;
+        };
+
+        Shard* shards;
+        std::size_t count;
+        std::size_t constructed = 0;
+        ShardBy by;
+
+        void Destroy()
+        {
+            while (constructed > 0)
+                shards[--constructed].~Shard();
+            ::operator delete(shards, std::align_val_t{alignof(Shard)});
+        }
+    public:
+        // Calls the factory once per shard, it returns T by value.
+        template<class F>
+        Sharded(const F& factoryFunction, std::size_t count, ShardBy by) :
+                ShardedBase(TypeId::Name<T>()),
+                shards(static_cast<Shard*>(::operator new(sizeof(Shard) * count, std::align_val_t{alignof(Shard)}))),
+                count(count), by(by)
+        {
+            try
+            {
+                for (; constructed < count; constructed++)
+                    new (&shards[constructed]) Shard{factoryFunction()};
+            }
+            catch (...)
+            {
+                Destroy();
+                throw;
+            }
+        }
+
+        Sharded(const Sharded&) = delete;
+        Sharded& operator=(const Sharded&) = delete;
+
+        ~Sharded() override
+        {
+            Destroy();
+        }
+
+        T& Current() const
+        {
+            return shards[Index(by, count)].instance;
+        }
+
+        template<class F>
+        void ForEach(const F& function) const
+        {
+            for (std::size_t index = 0; index < count; index++)
+                function(shards[index].instance);
+        }
+    };
+
+
+    template<typename T, typename F, std::enable_if_t<std::is_invocable<const F&>::value, int>>
+    void Injector::RegisterSharded(const F& factoryFunction, std::size_t shards, ShardBy by)
+    {
+        if (shards == 0)
+            shards = std::thread::hardware_concurrency();
+        auto registration = std::make_shared<Sharded<T>>(factoryFunction, shards == 0 ? 1 : shards, by);
+        Insert(&Registry::sharded, TypeId::Of<T>(), std::shared_ptr<ShardedBase>(std::move(registration)),
+               "Type already registered!");
+    }
+
+    template<typename T>
+    void Injector::RegisterSharded(std::size_t shards, ShardBy by)
+    {
+        RegisterSharded<T>([]()
+        { return T(); }, shards, by);
+    }
+
+    template<class T>
+    T* Injector::ResolveSharded()
+    {
+        auto pin = Guard();
+        auto* registration = Lookup(&Registry::sharded, TypeId::Of<T>(), TypeId::Of<T>(), ResolveCache::sharded);
+        if (registration == nullptr)
+            ThrowError("Type not registered!");
+        return &Checked<T, const Sharded<T>>(registration)->Current();
+    }
+
+    template<class T, class F>
+    void Injector::ForEachShard(const F& function)
+    {
+        auto pin = Guard();
+        auto* registration = Find(&Registry::sharded, TypeId::Of<T>());
+        if (registration == nullptr)
+            ThrowError("Type not registered!");
+        Checked<T, const Sharded<T>>(registration)->ForEach(function);
+    }
+}
+
+#endif //LIIINJECTOR_SHARDED_H
@@ -0,0 +1,225 @@
+#ifndef LIIINJECTOR_SHAREDHANDLE_H
+#define LIIINJECTOR_SHAREDHANDLE_H
+
+#include <atomic>
+#include <cstdint>
+#include <utility>
+
+namespace LiiInjector
+{
+    // Reference counts of a shared instance, allocated together with the instance.
+    // All strong references together hold one weak reference, so the block outlives the instance.
+    class SharedBlockBase
+    {
+    private:
+        std::atomic<std::uint32_t> strong{1};
+        std::atomic<std::uint32_t> weak{1};
+    protected:
+        virtual ~SharedBlockBase() = default;
+        virtual void DestroyInstance() = 0;
+    public:
+        void AddStrong()
+        {
+            strong.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        bool TryAddStrong()
+        {
+            auto count = strong.load(std::memory_order_relaxed);
+            while (count != 0)
+            {
+                if (strong.compare_exchange_weak(count, count + 1, std::memory_order_acq_rel, std::memory_order_relaxed))
+                    return true;
+            }
+            return false;
+        }
+
+        void ReleaseStrong()
+        {
+            if (strong.fetch_sub(1, std::memory_order_acq_rel) != 1)
+                return;
+            DestroyInstance();
+            ReleaseWeak();
+        }
+
+        void AddWeak()
+        {
+            weak.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        void ReleaseWeak()
+        {
+            if (weak.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                delete this;
+        }
+
+        std::uint32_t UseCount() const
+        {
+            return strong.load(std::memory_order_relaxed);
+        }
+    };
+
+
+    template<class T>
+    class SharedBlock final : public SharedBlockBase
+    {
+    private:
+        ~SharedBlock() override
+        {
+        }
+
+        void DestroyInstance() override
+        {
+            instance.~T();
+        }
+    public:
+        union
+        {
+            T instance;
+        };
+
+        // The factory returns T by value, which is constructed in place inside the block.
+        template<class F>
+        explicit SharedBlock(const F& factory) :
+                instance(factory())
+        {
+        }
+    };
+
+
+    template<class T>
+    class WeakHandle;
+
+    // Strong reference to a shared singleton. Keeps the instance alive after its Injector is gone.
+    template<class T>
+    class SharedHandle
+    {
+    private:
+        template<class> friend class WeakHandle;
+        SharedBlockBase* block = nullptr;
+        T* instance = nullptr;
+    public:
+        SharedHandle() = default;
+
+        // Takes over one strong reference the caller already owns.
+        SharedHandle(SharedBlockBase* block, T* instance) noexcept :
+                block(block), instance(instance)
+        {
+        }
+
+        SharedHandle(const SharedHandle& other) noexcept :
+                block(other.block), instance(other.instance)
+        {
+            if (block != nullptr)
+                block->AddStrong();
+        }
+
+        SharedHandle(SharedHandle&& other) noexcept :
+                block(std::exchange(other.block, nullptr)), instance(std::exchange(other.instance, nullptr))
+        {
+        }
+
+        SharedHandle& operator=(SharedHandle other) noexcept
+        {
+            std::swap(block, other.block);
+            std::swap(instance, other.instance);
+            return *this;
+        }
+
+        ~SharedHandle()
+        {
+            Reset();
+        }
+
+        void Reset()
+        {
+            if (block != nullptr)
+                block->ReleaseStrong();
+            block = nullptr;
+            instance = nullptr;
+        }
+
+        T* Get() const
+        {
+            return instance;
+        }
+
+        T* operator->() const
+        {
+            return instance;
+        }
+
+        T& operator*() const
+        {
+            return *instance;
+        }
+
+        explicit operator bool() const
+        {
+            return instance != nullptr;
+        }
+
+        std::uint32_t UseCount() const
+        {
+            return block == nullptr ? 0 : block->UseCount();
+        }
+    };
+
+
+    template<class T>
+    class WeakHandle
+    {
+    private:
+        SharedBlockBase* block = nullptr;
+        T* instance = nullptr;
+    public:
+        WeakHandle() = default;
+
+        WeakHandle(const SharedHandle<T>& shared) noexcept :
+                block(shared.block), instance(shared.instance)
+        {
+            if (block != nullptr)
+                block->AddWeak();
+        }
+
+        WeakHandle(const WeakHandle& other) noexcept :
+                block(other.block), instance(other.instance)
+        {
+            if (block != nullptr)
+                block->AddWeak();
+        }
+
+        WeakHandle(WeakHandle&& other) noexcept :
+                block(std::exchange(other.block, nullptr)), instance(std::exchange(other.instance, nullptr))
+        {
+        }
+
+        WeakHandle& operator=(WeakHandle other) noexcept
+        {
+            std::swap(block, other.block);
+            std::swap(instance, other.instance);
+            return *this;
+        }
+
+        ~WeakHandle()
+        {
+            if (block != nullptr)
+                block->ReleaseWeak();
+        }
+
+        // Returns an empty handle once the instance has been destroyed.
+        SharedHandle<T> Lock() const
+        {
+            if (block == nullptr || !block->TryAddStrong())
+                return SharedHandle<T>();
+            return SharedHandle<T>(block, instance);
+        }
+
+        bool Expired() const
+        {
+            return block == nullptr || block->UseCount() == 0;
+        }
+    };
+}
+
+#endif //LIIINJECTOR_SHAREDHANDLE_H
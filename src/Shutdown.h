@@ -0,0 +1,132 @@
+#ifndef LIIINJECTOR_SHUTDOWN_H
+#define LIIINJECTOR_SHUTDOWN_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+#include <vector>
+#include "Injector.hpp"
+
+namespace LiiInjector
+{
+    enum class ShutdownMode
+    {
+        Orderly,
+        // Singletons registered with Teardown::LeakOnFastShutdown are neither destroyed nor freed.
+        Fast
+    };
+
+    struct DestructorTiming
+    {
+        // TypeId::Name of the singleton.
+        const char* type;
+        std::uint32_t wave;
+        std::int64_t nanoseconds;
+        bool leaked;
+    };
+
+    struct ShutdownReport
+    {
+        // In destruction order, wave by wave.
+        std::vector<DestructorTiming> destructors;
+        std::uint32_t waves = 0;
+        std::int64_t nanoseconds = 0;
+    };
+
+
+    inline std::int64_t ElapsedSince(std::chrono::steady_clock::time_point begin)
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - begin).count();
+    }
+
+
+    inline ShutdownReport SingletonGraph::Release(std::size_t threads, ShutdownMode mode, TraceSink* tracer)
+    {
+        auto begin = std::chrono::steady_clock::now();
+        ShutdownReport report;
+        std::vector<std::uint32_t> heights(nodes.size(), 0);
+        std::size_t live = 0;
+        for (auto index = nodes.size(); index-- > 0;)
+        {
+            if (nodes[index].slot == nullptr)
+                continue;
+            live++;
+            for (auto dependency : nodes[index].dependencies)
+            {
+                if (heights[dependency] < heights[index] + 1)
+                    heights[dependency] = heights[index] + 1;
+            }
+            if (report.waves < heights[index] + 1)
+                report.waves = heights[index] + 1;
+        }
+
+        std::vector<std::vector<std::uint32_t>> waves(report.waves);
+        for (auto index = nodes.size(); index-- > 0;)
+        {
+            if (nodes[index].slot != nullptr)
+                waves[heights[index]].push_back(static_cast<std::uint32_t>(index));
+        }
+
+        report.destructors.resize(live);
+        std::size_t offset = 0;
+        for (std::uint32_t wave = 0; wave < waves.size(); wave++)
+        {
+            const auto& members = waves[wave];
+            std::atomic<std::size_t> next{0};
+            auto work = [&]()
+            {
+                for (auto position = next.fetch_add(1); position < members.size(); position = next.fetch_add(1))
+                {
+                    auto& node = nodes[members[position]];
+                    auto started = std::chrono::steady_clock::now();
+                    auto leaked = mode == ShutdownMode::Fast && node.teardown == Teardown::LeakOnFastShutdown &&
+                                  node.slot.use_count() == 1;
+                    if (leaked)
+                        node.slot->Leak();
+                    {
+                        TraceScope scope(tracer, leaked ? "Leak" : "Destroy", node.type);
+                        node.slot.reset();
+                    }
+                    report.destructors[offset + position] = DestructorTiming{node.type, wave, ElapsedSince(started), leaked};
+                }
+            };
+
+            std::vector<std::thread> workers;
+            auto count = threads < members.size() ? threads : members.size();
+            for (std::size_t worker = 1; worker < count; worker++)
+                workers.emplace_back(work);
+            work();
+            for (auto& worker : workers)
+                worker.join();
+            offset += members.size();
+        }
+
+        nodes.clear();
+        indices = {};
+        report.nanoseconds = ElapsedSince(begin);
+        return report;
+    }
+
+
+    inline ShutdownReport Injector::Shutdown(std::size_t threads)
+    {
+        return Shutdown(ShutdownMode::Orderly, threads);
+    }
+
+    inline ShutdownReport Injector::Shutdown(ShutdownMode mode, std::size_t threads)
+    {
+        graph.Settle();
+        registry = Registry();
+        inherited = Registry();
+        owned.clear();
+        Publish(Registry());
+        Synchronize();
+        if (threads == 0)
+            threads = std::thread::hardware_concurrency();
+        return graph.Release(threads == 0 ? 1 : threads, mode, tracer);
+    }
+}
+
+#endif //LIIINJECTOR_SHUTDOWN_H
@@ -0,0 +1,170 @@
+#ifndef LIIINJECTOR_THREADLOCAL_H
+#define LIIINJECTOR_THREADLOCAL_H
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "Injector.hpp"
+
+namespace LiiInjector
+{
+    // Factory of a thread local registration and the instances it built, one for each thread that resolved it.
+    // An instance is destroyed when its thread exits or when the registration is dropped, whichever comes first.
+    class ThreadLocalRegistration
+    {
+    private:
+        struct Instances
+        {
+            std::mutex mutex;
+            std::vector<std::unique_ptr<InstanceSlot>> slots;
+
+            void Remove(const InstanceSlot* instance)
+            {
+                std::unique_ptr<InstanceSlot> removed;
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    auto found = std::find_if(slots.begin(), slots.end(), [instance](const auto& slot)
+                    { return slot.get() == instance; });
+                    if (found == slots.end())
+                        return;
+                    removed = std::move(*found);
+                    slots.erase(found);
+                }
+            }
+        };
+
+        // A slot id is reused once its registration is dropped, the generation tells the registrations apart.
+        struct ThreadSlot
+        {
+            std::uint64_t generation = 0;
+            InstanceSlot* instance = nullptr;
+            std::weak_ptr<Instances> owner;
+        };
+
+        struct ThreadSlots
+        {
+            std::vector<ThreadSlot> slots;
+
+            ~ThreadSlots()
+            {
+                for (const auto& slot : slots)
+                {
+                    if (auto owner = slot.owner.lock())
+                        owner->Remove(slot.instance);
+                }
+            }
+        };
+
+        struct SlotIds
+        {
+            std::mutex mutex;
+            std::vector<std::uint32_t> free;
+            std::uint32_t next = 0;
+            std::uint64_t generation = 0;
+        };
+
+        // Never destroyed, registrations may be dropped during static destruction.
+        static SlotIds& Ids()
+        {
+            static auto* ids = new SlotIds();
+            return *ids;
+        }
+
+        static std::vector<ThreadSlot>& Slots()
+        {
+            thread_local ThreadSlots slots;
+            return slots.slots;
+        }
+
+        std::function<InstanceSlot()> factoryFunc;
+        std::shared_ptr<Instances> instances = std::make_shared<Instances>();
+        std::uint32_t slot;
+        std::uint64_t generation;
+    public:
+        explicit ThreadLocalRegistration(std::function<InstanceSlot()> factoryFunc) :
+                factoryFunc(std::move(factoryFunc))
+        {
+            auto& ids = Ids();
+            std::lock_guard<std::mutex> lock(ids.mutex);
+            generation = ++ids.generation;
+            if (ids.free.empty())
+                slot = ids.next++;
+            else
+            {
+                slot = ids.free.back();
+                ids.free.pop_back();
+            }
+        }
+
+        ThreadLocalRegistration(const ThreadLocalRegistration&) = delete;
+        ThreadLocalRegistration& operator=(const ThreadLocalRegistration&) = delete;
+
+        // Destroys the instances of every thread on the calling thread.
+        virtual ~ThreadLocalRegistration()
+        {
+            std::vector<std::unique_ptr<InstanceSlot>> dropped;
+            {
+                std::lock_guard<std::mutex> lock(instances->mutex);
+                dropped.swap(instances->slots);
+            }
+            dropped.clear();
+            auto& ids = Ids();
+            std::lock_guard<std::mutex> lock(ids.mutex);
+            ids.free.push_back(slot);
+        }
+
+        // Builds the calling thread's instance on first use. Virtual, so it always runs in the module that created
+        // the registration and uses the slot tables its slot id belongs to.
+        virtual InstanceSlot& Get() const
+        {
+            auto& slots = Slots();
+            if (slot < slots.size() && slots[slot].generation == generation)
+                return *slots[slot].instance;
+
+            // The factory may resolve other thread locals, which can grow the table.
+            auto created = std::make_unique<InstanceSlot>(factoryFunc());
+            auto* instance = created.get();
+            {
+                std::lock_guard<std::mutex> lock(instances->mutex);
+                instances->slots.push_back(std::move(created));
+            }
+            if (slot >= slots.size())
+                slots.resize(slot + 1);
+            slots[slot] = ThreadSlot{generation, instance, instances};
+            return *instance;
+        }
+    };
+
+
+    template<typename T>
+    void Injector::RegisterThreadLocal()
+    {
+        RegisterThreadLocal<T>([]()
+        { return new T(); });
+    }
+
+    template<typename T, typename F>
+    void Injector::RegisterThreadLocal(const F& factoryFunction)
+    {
+        auto registration = std::make_shared<ThreadLocalRegistration>([factoryFunction]()
+        { return InstanceSlot::Adopt<T>(factoryFunction()); });
+        Insert(&Registry::threadLocals, TypeId::Of<T>(), std::move(registration), "Type already registered!");
+    }
+
+    template<class T>
+    T* Injector::ResolveThreadLocal()
+    {
+        auto* registration = Find(&Registry::threadLocals, TypeId::Of<T>());
+        if (registration == nullptr)
+            ThrowError("Type not registered!");
+        auto* result = registration->Get().template Get<T>();
+        if (result == nullptr)
+            ThrowError("Type mismatch!");
+        return result;
+    }
+}
+
+#endif //LIIINJECTOR_THREADLOCAL_H
@@ -0,0 +1,48 @@
+#ifndef LIIINJECTOR_TRACESINK_H
+#define LIIINJECTOR_TRACESINK_H
+
+#include <cstdint>
+
+namespace LiiInjector
+{
+    // Receives the events of Injector::SetTracer. Tracer in Tracer.h records them into a Chrome trace, so only
+    // translation units that trace pay for it.
+    class TraceSink
+    {
+    public:
+        virtual ~TraceSink() = default;
+
+        // Nanoseconds since an arbitrary start.
+        virtual std::int64_t Now() const = 0;
+        virtual void Record(const char* name, const char* detail, std::int64_t begin, std::int64_t end) = 0;
+    };
+
+
+    // Records the time between its construction and destruction. Does nothing without a tracer.
+    class TraceScope
+    {
+    private:
+        TraceSink* tracer;
+        const char* name;
+        const char* detail;
+        std::int64_t begin = 0;
+    public:
+        TraceScope(TraceSink* tracer, const char* name, const char* detail) :
+                tracer(tracer), name(name), detail(detail)
+        {
+            if (tracer != nullptr)
+                begin = tracer->Now();
+        }
+
+        TraceScope(const TraceScope&) = delete;
+        TraceScope& operator=(const TraceScope&) = delete;
+
+        ~TraceScope()
+        {
+            if (tracer != nullptr)
+                tracer->Record(name, detail, begin, tracer->Now());
+        }
+    };
+}
+
+#endif //LIIINJECTOR_TRACESINK_H
@@ -0,0 +1,180 @@
+#ifndef LIIINJECTOR_TRACER_H
+#define LIIINJECTOR_TRACER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+#include <ostream>
+#include <thread>
+#include <utility>
+#include "TraceSink.h"
+
+namespace LiiInjector
+{
+    struct TraceEvent
+    {
+        const char* name;
+        const char* detail;
+        std::int64_t begin;
+        std::int64_t end;
+    };
+
+    // Events of one thread. Only the owning thread writes, the oldest events are overwritten once it is full.
+    class TraceBuffer
+    {
+    public:
+        static constexpr std::size_t capacity = 4096;
+
+        std::thread::id thread;
+        std::uint32_t index;
+        TraceBuffer* next = nullptr;
+        std::atomic<std::uint64_t> written{0};
+        TraceEvent events[capacity];
+
+        TraceBuffer(std::thread::id thread, std::uint32_t index) :
+                thread(thread), index(index)
+        {
+        }
+
+        void Push(const TraceEvent& event)
+        {
+            auto position = written.load(std::memory_order_relaxed);
+            events[position % capacity] = event;
+            written.store(position + 1, std::memory_order_release);
+        }
+    };
+
+
+    // Opt-in startup timeline, set with Injector::SetTracer. Recording never locks, each thread appends to its
+    // own ring buffer. Names and details have to be string literals or otherwise outlive the Tracer.
+    class Tracer : public TraceSink
+    {
+    private:
+        std::atomic<TraceBuffer*> buffers{nullptr};
+        std::atomic<std::uint32_t> bufferCount{0};
+        std::uint64_t id = NextId();
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+        static std::uint64_t NextId()
+        {
+            static std::atomic<std::uint64_t> counter{1};
+            return counter.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        TraceBuffer& ThreadBuffer()
+        {
+            struct Cache
+            {
+                std::uint64_t tracer = 0;
+                TraceBuffer* buffer = nullptr;
+            };
+            thread_local Cache cache;
+            if (cache.tracer == id)
+                return *cache.buffer;
+
+            auto thread = std::this_thread::get_id();
+            for (auto* buffer = buffers.load(std::memory_order_acquire); buffer != nullptr; buffer = buffer->next)
+            {
+                if (buffer->thread == thread)
+                {
+                    cache = Cache{id, buffer};
+                    return *buffer;
+                }
+            }
+
+            auto* buffer = new TraceBuffer(thread, bufferCount.fetch_add(1, std::memory_order_relaxed));
+            buffer->next = buffers.load(std::memory_order_relaxed);
+            while (!buffers.compare_exchange_weak(buffer->next, buffer, std::memory_order_release, std::memory_order_relaxed))
+            {
+            }
+            cache = Cache{id, buffer};
+            return *buffer;
+        }
+
+        static void WriteMicroseconds(std::ostream& output, std::int64_t nanoseconds)
+        {
+            auto fraction = nanoseconds % 1000;
+            output << nanoseconds / 1000 << '.' << fraction / 100 << fraction / 10 % 10 << fraction % 10;
+        }
+
+        static void WriteString(std::ostream& output, const char* text)
+        {
+            output << '"';
+            for (; *text != '\0'; text++)
+            {
+                if (*text == '"' || *text == '\\')
+                    output << '\\';
+                output << *text;
+            }
+            output << '"';
+        }
+    public:
+        Tracer() = default;
+        Tracer(const Tracer&) = delete;
+        Tracer& operator=(const Tracer&) = delete;
+
+        ~Tracer() override
+        {
+            auto* buffer = buffers.load(std::memory_order_acquire);
+            while (buffer != nullptr)
+                delete std::exchange(buffer, buffer->next);
+        }
+
+        // Nanoseconds since the Tracer was created.
+        std::int64_t Now() const override
+        {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+        }
+
+        void Record(const char* name, const char* detail, std::int64_t begin, std::int64_t end) override
+        {
+            ThreadBuffer().Push(TraceEvent{name, detail, begin, end});
+        }
+
+        std::size_t EventCount() const
+        {
+            std::size_t count = 0;
+            for (auto* buffer = buffers.load(std::memory_order_acquire); buffer != nullptr; buffer = buffer->next)
+            {
+                auto written = buffer->written.load(std::memory_order_acquire);
+                count += static_cast<std::size_t>(written < TraceBuffer::capacity ? written : TraceBuffer::capacity);
+            }
+            return count;
+        }
+
+        // Writes a Chrome trace event file, which chrome://tracing and Perfetto open. Call it once the traced
+        // threads stopped resolving, events written during the export may be torn.
+        void Export(std::ostream& output) const
+        {
+            output << "{\"traceEvents\":[";
+            bool first = true;
+            for (auto* buffer = buffers.load(std::memory_order_acquire); buffer != nullptr; buffer = buffer->next)
+            {
+                auto written = buffer->written.load(std::memory_order_acquire);
+                auto begin = written < TraceBuffer::capacity ? 0 : written - TraceBuffer::capacity;
+                for (auto position = begin; position < written; position++)
+                {
+                    const auto& event = buffer->events[position % TraceBuffer::capacity];
+                    output << (first ? "\n" : ",\n") << "{\"name\":";
+                    WriteString(output, event.name);
+                    output << ",\"cat\":\"LiiInjector\",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->index << ",\"ts\":";
+                    WriteMicroseconds(output, event.begin);
+                    output << ",\"dur\":";
+                    WriteMicroseconds(output, event.end - event.begin);
+                    if (event.detail != nullptr)
+                    {
+                        output << ",\"args\":{\"type\":";
+                        WriteString(output, event.detail);
+                        output << '}';
+                    }
+                    output << '}';
+                    first = false;
+                }
+            }
+            output << "\n],\"displayTimeUnit\":\"ms\"}\n";
+        }
+    };
+}
+
+#endif //LIIINJECTOR_TRACER_H
@@ -0,0 +1,64 @@
+// Compiles a text manifest into the binary form read by LiiInjector::Manifest.
+// Every non empty line that does not start with # binds a tag to a factory id:
+//     <tag> <singleton|transient> <factory id>
+#include <cstdint>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include "ManifestFile.h"
+
+using namespace LiiInjector;
+
+int main(int argc, char** argv)
+{
+    if (argc != 3)
+    {
+        std::cerr << "Usage: " << argv[0] << " <input.txt> <output.bin>" << std::endl;
+        return 2;
+    }
+
+    std::ifstream input(argv[1]);
+    if (!input)
+    {
+        std::cerr << "Cannot open " << argv[1] << std::endl;
+        return 1;
+    }
+
+    try
+    {
+        ManifestWriter writer;
+        std::string line;
+        for (int lineNumber = 1; std::getline(input, line); lineNumber++)
+        {
+            std::istringstream fields(line);
+            std::string tag;
+            std::string kind;
+            std::uint32_t factoryId = 0;
+            if (!(fields >> tag) || tag[0] == '#')
+                continue;
+            if (!(fields >> kind >> factoryId) || (kind != "singleton" && kind != "transient"))
+            {
+                std::cerr << argv[1] << ":" << lineNumber << ": expected <tag> <singleton|transient> <factory id>" << std::endl;
+                return 1;
+            }
+            writer.Add(tag, kind == "singleton" ? ManifestKind::Singleton : ManifestKind::Transient, factoryId);
+        }
+
+        auto manifest = writer.Build();
+        std::ofstream output(argv[2], std::ios::binary);
+        output.write(manifest.data(), static_cast<std::streamsize>(manifest.size()));
+        if (!output)
+        {
+            std::cerr << "Cannot write " << argv[2] << std::endl;
+            return 1;
+        }
+    }
+    catch (const std::exception& exception)
+    {
+        std::cerr << exception.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}